@@ -1,11 +1,80 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <sys/types.h>
+
+struct gpu_engine_t {
+    char    name[16];
+    float   load;
+};
+
+// utilization of every engine class from fdinfo (gfx, compute, copy,
+// video decode/encode etc.) in percent of engine class capacity
+struct gpu_engines_t {
+    uint8_t         num_of_engines;
+    gpu_engine_t    engines[10];
+};
+
+// any process using the gpu, not only clients
+struct gpu_client_t {
+    int32_t pid;
+    char    name[16];
+    // sum over engines
+    float   load;
+    float   vram_used;
+    float   gtt_used;
+};
+
+enum gpu_event_type : uint8_t {
+    GPU_EVENT_THROTTLE,
+    GPU_EVENT_XID,
+    GPU_EVENT_POWER_SOURCE,
+    GPU_EVENT_TYPE_COUNT
+};
+
+// reported by driver as it happens, timestamp is CLOCK_MONOTONIC.
+// data is throttle reasons bitmask of the driver (0 when throttling
+// ends), xid error number or new power source.
+struct gpu_event_t {
+    uint64_t    timestamp_ns;
+    uint8_t     type;
+    uint64_t    data;
+};
+
+// CPU core of an APU, temp in celsius
+struct gpu_apu_core_t {
+    int     clock;
+    int     temp;
+};
+
+// min, max, mean and percentiles of samples taken since previous poll
+struct gpu_sample_stats_t {
+    float   min;
+    float   max;
+    float   mean;
+    float   p5;
+    float   p95;
+};
+
+// only with MANGOHUD_AMDGPU_SAMPLE_MS, num_of_samples is 0 otherwise
+struct gpu_samples_t {
+    uint16_t            num_of_samples;
+    gpu_sample_stats_t  load;
+    gpu_sample_stats_t  core_clock;
+    gpu_sample_stats_t  memory_clock;
+    gpu_sample_stats_t  power_usage;
+    gpu_sample_stats_t  temperature;
+};
 
 struct gpu_metrics_process_t {
     int     load;
     float   vram_used;
     float   gtt_used;
+
+    gpu_engines_t engines;
 };
 
 struct gpu_metrics_system_t {
@@ -37,6 +106,36 @@ struct gpu_metrics_system_t {
 
     int     fan_speed;
     bool    fan_rpm;
+
+    // whole package and SoC power on APUs, 0 if not reported
+    float   socket_power;
+    float   soc_power;
+
+    // speed in GT/s, bandwidth in GB/s
+    int     pcie_link_width;
+    float   pcie_link_speed;
+    float   pcie_bandwidth;
+
+    // clock requested by driver, core_clock is the actual one
+    int     requested_clock;
+    // % of time spent in low power idle state (RC6 on Intel)
+    float   idle_residency;
+
+    uint8_t         num_of_apu_cores;
+    gpu_apu_core_t  apu_cores[16];
+
+    gpu_samples_t   samples;
+
+    // sum over all tracked processes
+    gpu_engines_t engines;
+
+    // ordered by load, then vram and gtt, only with MANGOHUD_GPU_TOP
+    uint8_t         num_of_top_clients;
+    gpu_client_t    top_clients[8];
+
+    // most recent events, oldest first
+    uint8_t         num_of_events;
+    gpu_event_t     events[16];
 };
 
 struct gpu_t {
@@ -54,6 +153,76 @@ struct memory_t {
     float process_resident  = 0;
     float process_shared    = 0;
     float process_virtual   = 0;
+
+    float process_pss       = 0;
+    float process_swap      = 0;
+    float process_anon      = 0;
+    float process_file      = 0;
+
+    float process_minor_faults_per_sec = 0;
+    float process_major_faults_per_sec = 0;
+};
+
+// system-wide /proc/meminfo values, all in GiB
+struct system_memory_t {
+    float used              = 0;
+    float total             = 0;
+    float swap_used         = 0;
+
+    float cached            = 0;
+    float buffers           = 0;
+    float dirty             = 0;
+    float writeback         = 0;
+    float anon              = 0;
+    float shmem             = 0;
+
+    float anon_hugepages    = 0;
+    float hugetlb_total     = 0;
+    float hugetlb_free      = 0;
+
+    float zswap             = 0;
+    float zswapped          = 0;
+
+    float committed         = 0;
+    float commit_limit      = 0;
+};
+
+// /proc/vmstat counters as events per second
+struct vmstat_t {
+    float pswpin                = 0.f;
+    float pswpout               = 0.f;
+    float pgmajfault            = 0.f;
+    float compact_stall         = 0.f;
+    float allocstall            = 0.f;
+    float thp_fault_fallback    = 0.f;
+    float workingset_refault    = 0.f;
+};
+
+enum psi_resource : uint8_t {
+    PSI_CPU,
+    PSI_MEMORY,
+    PSI_IO,
+    PSI_RESOURCE_COUNT
+};
+
+// averages are in percent, totals are in microseconds
+struct pressure_stall_t {
+    float       some_avg10      = 0.f;
+    float       full_avg10      = 0.f;
+    uint64_t    some_total_us   = 0;
+    uint64_t    full_total_us   = 0;
+};
+
+struct pressure_t {
+    pressure_stall_t resources[PSI_RESOURCE_COUNT];
+};
+
+// PSI trigger fired, timestamp is CLOCK_MONOTONIC
+struct stall_event_t {
+    uint64_t    timestamp_ns    = 0;
+    uint8_t     resource        = 0;
+    bool        is_cgroup       = false;
+    uint64_t    some_total_us   = 0;
 };
 
 struct io_stats_t {
@@ -68,6 +237,89 @@ typedef struct core_info_t {
    float power    = 0.f;
 } cpu_info_t;
 
+// run_delay is time spent runnable but waiting on a run queue,
+// in milliseconds per second
+struct thread_info_t {
+    char    name[16]                        = {};
+    int     tid                             = 0;
+    float   load                            = 0.f;
+    int     cpu                             = 0;
+
+    float   run_delay                       = 0.f;
+    float   voluntary_switches_per_sec      = 0.f;
+    float   involuntary_switches_per_sec    = 0.f;
+};
+
+// load is in percent of a single core, like in top
+struct process_cpu_t {
+    float load = 0.f;
+
+    // sum of all threads for clients subscribed to "sched",
+    // main thread only otherwise
+    float run_delay                     = 0.f;
+    float voluntary_switches_per_sec    = 0.f;
+    float involuntary_switches_per_sec  = 0.f;
+
+    // busiest threads, for clients subscribed to "threads" or "sched"
+    uint8_t num_of_threads = 0;
+    thread_info_t threads[8];
+
+    // threads with the highest run delay, for clients subscribed to "sched"
+    uint8_t num_of_delayed_threads = 0;
+    thread_info_t delayed_threads[8];
+};
+
+// cgroup v2 counters of the client's cgroup (systemd scope, flatpak
+// instance, ...), memory is in bytes
+struct cgroup_stats_t {
+    bool        valid                       = false;
+
+    // cpu.stat, cpu_load is in percent of a single core
+    float       cpu_load                    = 0.f;
+    float       throttled_ms_per_sec        = 0.f;
+    uint64_t    nr_throttled                = 0;
+
+    // memory.current, memory.stat
+    float       memory_current              = 0.f;
+    float       memory_anon                 = 0.f;
+    float       memory_file                 = 0.f;
+    float       memory_shmem                = 0.f;
+    float       memory_kernel               = 0.f;
+    float       major_faults_per_sec        = 0.f;
+    float       workingset_refault_per_sec  = 0.f;
+
+    // io.stat, summed over all devices
+    float       read_mb_per_sec             = 0.f;
+    float       write_mb_per_sec            = 0.f;
+
+    // memory.events
+    uint64_t    memory_high_events          = 0;
+    uint64_t    memory_max_events           = 0;
+    uint64_t    oom_events                  = 0;
+    uint64_t    oom_kill_events             = 0;
+};
+
+// sum over the client and its descendants ("tree") or over all
+// processes of its cgroup ("cgroup"), memory is in bytes
+struct process_group_t {
+    uint16_t    num_of_processes    = 0;
+
+    float       cpu_load            = 0.f;
+    float       resident            = 0.f;
+    float       pss                 = 0.f;
+    float       swap                = 0.f;
+    float       read_mb_per_sec     = 0.f;
+    float       write_mb_per_sec    = 0.f;
+
+    gpu_metrics_process_t gpus[8]   = {};
+};
+
+struct cpu_power_domain_t {
+    char        name[32]    = {};
+    float       power       = 0.f;
+    uint64_t    energy_uj   = 0;
+};
+
 struct mangohud_message {
     uint8_t num_of_gpus;
     gpu_t gpus[8];
@@ -78,6 +330,17 @@ struct mangohud_message {
     cpu_info_t cpu;
     uint16_t num_of_cores;
     core_info_t cores[1024];
+
+    process_cpu_t process_cpu;
+    process_group_t process_group;
+    cgroup_stats_t cgroup;
+
+    pressure_t pressure;
+    pressure_t cgroup_pressure;
+
+    // stall events since previous message
+    uint8_t num_of_stall_events;
+    stall_event_t stall_events[16];
 };
 
 struct process_metrics {
@@ -86,8 +349,22 @@ struct process_metrics {
         float resident = 0;
         float shared = 0;
         float virt = 0;
+
+        float pss = 0;
+        float swap = 0;
+        float anon = 0;
+        float file = 0;
+
+        float minor_faults_per_sec = 0;
+        float major_faults_per_sec = 0;
     } memory;
     io_stats_t io_stats;
+    process_cpu_t cpu;
+    pressure_t cgroup_pressure;
+
+    bool is_client = false;
+    process_group_t group;
+    cgroup_stats_t cgroup;
 };
 
 struct metrics {
@@ -95,14 +372,20 @@ struct metrics {
     uint16_t num_of_cores;
     core_info_t cores[1024];
 
+    uint8_t num_of_power_domains;
+    cpu_power_domain_t power_domains[16];
+
     uint8_t num_of_gpus;
     gpu_metrics_system_t gpus[8];
 
-    struct {
-        float used = 0;
-        float total = 0;
-        float swap_used = 0;
-    } memory;
+    system_memory_t memory;
+    vmstat_t vmstat;
+
+    pressure_t pressure;
+
+    // most recent system-wide stall events
+    uint8_t num_of_stall_events;
+    stall_event_t stall_events[16];
 
     std::unordered_map<pid_t, process_metrics> pids;
 };
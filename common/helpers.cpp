@@ -1,5 +1,9 @@
 #include <fstream>
 #include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
 #include <spdlog/spdlog.h>
 #include "helpers.hpp"
 
@@ -37,3 +41,49 @@ uint64_t try_stoull(const std::string& str) {
 
     return 0;
 }
+
+bool pread_uint64(int fd, uint64_t& val) {
+    char buf[32];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if (len <= 0)
+        return false;
+
+    buf[len] = '\0';
+
+    char* end = nullptr;
+    errno = 0;
+    uint64_t tmp = std::strtoull(buf, &end, 10);
+
+    if (end == buf || errno != 0)
+        return false;
+
+    val = tmp;
+    return true;
+}
+
+ssize_t pread_all(int fd, std::vector<char>& buf) {
+    if (buf.size() < 4096)
+        buf.resize(4096);
+
+    size_t total = 0;
+
+    while (true) {
+        size_t requested = buf.size() - total - 1;
+        ssize_t len = pread(fd, buf.data() + total, requested, total);
+
+        if (len < 0)
+            return -1;
+
+        total += len;
+
+        // short read means that whole file was read
+        if (static_cast<size_t>(len) < requested)
+            break;
+
+        buf.resize(buf.size() * 2);
+    }
+
+    buf[total] = '\0';
+    return total;
+}
@@ -2,7 +2,14 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
+#include <sys/types.h>
 
 std::string read_line(const std::string& filename);
 bool ends_with(std::string s1, std::string s2, bool ignore_case = false);
 uint64_t try_stoull(const std::string& str);
+bool pread_uint64(int fd, uint64_t& val);
+
+// reads the whole file into buf and null-terminates it. buf only
+// grows, so repeated reads of the same file don't allocate.
+ssize_t pread_all(int fd, std::vector<char>& buf);
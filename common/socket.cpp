@@ -53,7 +53,7 @@ bool receive_message(int fd, mangohud_message& msg) {
     return true;
 }
 
-bool receive_message_with_creds(int fd, size_t& pid) {
+bool receive_message_with_creds(int fd, size_t& pid, std::string& payload) {
     const size_t buf_size = 4096;
     std::vector<char> buf(buf_size);
 
@@ -103,6 +103,7 @@ bool receive_message_with_creds(int fd, size_t& pid) {
     );
 
     pid = ucredp->pid;
+    payload = std::move(s);
     return true;
 }
 
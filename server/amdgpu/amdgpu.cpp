@@ -1,17 +1,79 @@
+#include <cstdlib>
 #include "amdgpu.hpp"
 
 AMDGPU::AMDGPU(
     const std::string& drm_node, const std::string& pci_dev,
     uint16_t vendor_id, uint16_t device_id
 ) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-amdgpu"),
-    FDInfo(drm_node), AMDGPUMetrics(drm_node) 
+    FDInfo(drm_node, pci_dev), AMDGPUMetrics(drm_node) 
 {
-    hwmon.setup(sensors, drm_node);
+    metrics_available = gpu_metrics.setup();
+    drm_available = drm.setup(drm_node);
+
+    if (drm_available) {
+        // gpu_metrics has these already
+        if (!metrics_available) {
+            enable_drm_sensor(amdgpu_drm_base::SENSOR_LOAD, { "load" });
+            enable_drm_sensor(amdgpu_drm_base::SENSOR_MEMORY_CLOCK, { "memory_clock" });
+            enable_drm_sensor(amdgpu_drm_base::SENSOR_TEMPERATURE, { "temperature" });
+
+            // newer SMUs only have input power
+            if (drm.enable_sensor(amdgpu_drm_base::SENSOR_AVERAGE_POWER))
+                drm_power_sensor = amdgpu_drm_base::SENSOR_AVERAGE_POWER;
+            else if (drm.enable_sensor(amdgpu_drm_base::SENSOR_INPUT_POWER))
+                drm_power_sensor = amdgpu_drm_base::SENSOR_INPUT_POWER;
+
+            if (drm_power_sensor != amdgpu_drm_base::SENSOR_COUNT)
+                drm_sensors.insert({ "average_power", "current_power" });
+        }
+
+        enable_drm_sensor(amdgpu_drm_base::SENSOR_CORE_CLOCK, { "frequency" });
+        enable_drm_sensor(amdgpu_drm_base::SENSOR_VOLTAGE, { "voltage" });
+
+        if (drm.has_memory_info())
+            drm_sensors.insert({ "vram_used", "gtt_used", "vram_total" });
+    }
+
+    hwmon.setup(sysfs_only(sensors), drm_node);
 
     sysfs_hwmon.base_dir = "/sys/class/drm/" + drm_node + "/device";
-    sysfs_hwmon.setup(sysfs_sensors);
+    sysfs_hwmon.setup(sysfs_only(sysfs_sensors));
 
-    metrics_available = gpu_metrics.setup();
+    // sample gpu_metrics every few ms, to catch spikes between polls
+    const char* sample_ms = getenv("MANGOHUD_AMDGPU_SAMPLE_MS");
+
+    if (metrics_available && sample_ms && std::atoi(sample_ms) > 0)
+        gpu_metrics.start_sampling(std::chrono::milliseconds(std::atoi(sample_ms)));
+}
+
+void AMDGPU::enable_drm_sensor(amdgpu_drm_base::sensor s, const std::vector<std::string>& names) {
+    if (drm.enable_sensor(s))
+        drm_sensors.insert(names.begin(), names.end());
+}
+
+bool AMDGPU::is_drm_sensor(std::string_view name) const {
+    return drm_sensors.find(name) != drm_sensors.end();
+}
+
+std::vector<hwmon_sensor> AMDGPU::sysfs_only(const std::vector<hwmon_sensor>& list) const {
+    // values from gpu_metrics, see getters
+    static const std::set<std::string, std::less<>> metrics_sensors = {
+        "load", "memory_clock", "temperature", "average_power", "current_power"
+    };
+
+    std::vector<hwmon_sensor> out;
+
+    for (const auto& s : list) {
+        if (is_drm_sensor(s.generic_name))
+            continue;
+
+        if (metrics_available && metrics_sensors.count(s.generic_name))
+            continue;
+
+        out.push_back(s);
+    }
+
+    return out;
 }
 
 void AMDGPU::pre_poll_overrides() {
@@ -19,6 +81,9 @@ void AMDGPU::pre_poll_overrides() {
     sysfs_hwmon.poll_sensors();
     fdinfo.poll_all();
 
+    if (drm_available)
+        drm.poll();
+
     if (metrics_available)
         gpu_metrics.poll();
 }
@@ -26,21 +91,32 @@ void AMDGPU::pre_poll_overrides() {
 int AMDGPU::get_load() {
     if (metrics_available)
         return gpu_metrics.metrics.gpu_load_percent;
+    else if (is_drm_sensor("load"))
+        return drm.get_sensor(amdgpu_drm_base::SENSOR_LOAD);
     else
         return sysfs_hwmon.get_sensor_value("load");
 }
 
 float AMDGPU::get_vram_used() {
+    if (is_drm_sensor("vram_used"))
+        return drm.get_vram_used() / 1024.f / 1024.f / 1024.f;
+
     float used = sysfs_hwmon.get_sensor_value("vram_used") / 1024.f / 1024.f / 1024.f;
     return used;
 }
 
 float AMDGPU::get_gtt_used() {
+    if (is_drm_sensor("gtt_used"))
+        return drm.get_gtt_used() / 1024.f / 1024.f / 1024.f;
+
     float used = sysfs_hwmon.get_sensor_value("gtt_used") / 1024.f / 1024.f / 1024.f;
     return used;
 }
 
 float AMDGPU::get_memory_total() {
+    if (is_drm_sensor("vram_total"))
+        return drm.get_vram_total() / 1024.f / 1024.f / 1024.f;
+
     float used = sysfs_hwmon.get_sensor_value("vram_total") / 1024.f / 1024.f / 1024.f;
     return used;
 }
@@ -48,12 +124,17 @@ float AMDGPU::get_memory_total() {
 int AMDGPU::get_memory_clock() {
     if (metrics_available)
         return gpu_metrics.metrics.current_uclk_mhz;
+    else if (is_drm_sensor("memory_clock"))
+        return drm.get_sensor(amdgpu_drm_base::SENSOR_MEMORY_CLOCK);
     else
         return hwmon.get_sensor_value("memory_clock") / 1'000'000.f;
 }
 
 int AMDGPU::get_memory_temp() {
-    return hwmon.get_sensor_value("memory_temp");
+    if (metrics_available && gpu_metrics.metrics.mem_temp_c)
+        return gpu_metrics.metrics.mem_temp_c;
+    else
+        return std::round(hwmon.get_sensor_value("memory_temp") / 1'000.f);
 }
 
 int AMDGPU::get_temperature() {
@@ -62,6 +143,8 @@ int AMDGPU::get_temperature() {
             return gpu_metrics.metrics.apu_cpu_temp_c;
         else
             return gpu_metrics.metrics.gpu_temp_c;
+    } else if (is_drm_sensor("temperature")) {
+        return std::round(drm.get_sensor(amdgpu_drm_base::SENSOR_TEMPERATURE) / 1'000.f);
     } else {
         float temp = hwmon.get_sensor_value("temperature") / 1'000.f;
         return std::round(temp);
@@ -69,7 +152,10 @@ int AMDGPU::get_temperature() {
 }
 
 int AMDGPU::get_junction_temperature() {
-    return hwmon.get_sensor_value("junction_temp");
+    if (metrics_available && gpu_metrics.metrics.hotspot_temp_c)
+        return gpu_metrics.metrics.hotspot_temp_c;
+    else
+        return std::round(hwmon.get_sensor_value("junction_temp") / 1'000.f);
 }
 
 int AMDGPU::get_core_clock() {
@@ -77,17 +163,24 @@ int AMDGPU::get_core_clock() {
     // always use core clock from GPU metrics.
     if (metrics_available && (device_id == 0x1435 || device_id == 0x163f))
         return gpu_metrics.metrics.current_gfxclk_mhz;
+    else if (is_drm_sensor("frequency"))
+        return drm.get_sensor(amdgpu_drm_base::SENSOR_CORE_CLOCK);
     else
         return hwmon.get_sensor_value("frequency") / 1'000'000.f;
 }
 
 int AMDGPU::get_voltage() {
+    if (is_drm_sensor("voltage"))
+        return drm.get_sensor(amdgpu_drm_base::SENSOR_VOLTAGE);
+
     return hwmon.get_sensor_value("voltage");
 }
 
 float AMDGPU::get_power_usage() {
     if (metrics_available)
         return gpu_metrics.metrics.average_gfx_power_w;
+    else if (drm_power_sensor != amdgpu_drm_base::SENSOR_COUNT)
+        return drm.get_sensor(drm_power_sensor);
     else {
         if (hwmon.is_open("average_power"))
             return hwmon.get_sensor_value("average_power") / 1'000'000.f;
@@ -156,30 +249,74 @@ int AMDGPU::get_fan_speed() {
         return hwmon.get_sensor_value("fan");
 }
 
-int AMDGPU::get_process_load(pid_t pid) {
-    uint64_t* previous_gpu_time = &previous_gpu_times[pid];
-    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, "drm-engine-gfx");
+float AMDGPU::get_socket_power() {
+    if (metrics_available)
+        return gpu_metrics.metrics.average_socket_power_w;
+    else
+        return 0.f;
+}
 
-    if (!*previous_gpu_time) {
-        *previous_gpu_time = gpu_time_now;
+float AMDGPU::get_soc_power() {
+    if (metrics_available)
+        return gpu_metrics.metrics.average_soc_power_w;
+    else
+        return 0.f;
+}
+
+int AMDGPU::get_pcie_link_width() {
+    if (metrics_available)
+        return gpu_metrics.metrics.pcie_link_width;
+    else
+        return 0;
+}
+
+float AMDGPU::get_pcie_link_speed() {
+    if (metrics_available)
+        return gpu_metrics.metrics.pcie_link_speed;
+    else
+        return 0.f;
+}
+
+float AMDGPU::get_pcie_bandwidth() {
+    if (metrics_available)
+        return gpu_metrics.metrics.pcie_bandwidth;
+    else
+        return 0.f;
+}
+
+uint8_t AMDGPU::get_apu_cores(gpu_apu_core_t* out, uint8_t max) {
+    if (!metrics_available)
         return 0;
+
+    uint8_t count = 0;
+
+    for (; count < gpu_metrics.metrics.num_of_cores && count < max; count++) {
+        out[count].clock = gpu_metrics.metrics.core_clock_mhz[count];
+        out[count].temp = gpu_metrics.metrics.core_temp_c[count];
     }
 
-    float delta_gpu_time = gpu_time_now - *previous_gpu_time;
-    float result = delta_gpu_time / delta_time_ns.count() * 100;
+    return count;
+}
 
-    if (result > 100.f)
-        result = 100.f;
+void AMDGPU::get_samples(gpu_samples_t& samples) {
+    if (metrics_available)
+        samples = gpu_metrics.samples;
+}
 
-    *previous_gpu_time = gpu_time_now;
+int AMDGPU::get_process_load(pid_t pid) {
+    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, gfx_time_key);
 
-    return std::round(result);
+    return get_gpu_time_load(fdinfo, pid, gpu_time_now);
 }
 
 float AMDGPU::get_process_vram_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-memory-vram");
+    return fdinfo.get_memory_used(pid, vram_key);
 }
 
 float AMDGPU::get_process_gtt_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-memory-gtt");
+    return fdinfo.get_memory_used(pid, gtt_key);
+}
+
+void AMDGPU::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    fdinfo.get_engine_loads(pid, engines);
 }
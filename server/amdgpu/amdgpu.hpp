@@ -1,13 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <set>
 
 #include "gpu.hpp"
 #include "hwmon.hpp"
 #include "fdinfo.hpp"
 #include "gpu_metrics.hpp"
+#include "amdgpu_drm.hpp"
 
-class AMDGPU : public GPU, private Hwmon, public FDInfo, private AMDGPUMetrics {
+class AMDGPU : public GPU, private Hwmon, public FDInfo, private AMDGPUMetrics, private amdgpu_drm {
 private:
     const std::vector<hwmon_sensor> sensors = {
         { "temperature"  ,  "temp1_input"     },
@@ -30,9 +32,21 @@ private:
     };
 
     HwmonBase sysfs_hwmon;
-    std::map<pid_t, uint64_t> previous_gpu_times;
+
+    const fdinfo_key gfx_time_key = drm_clients.get_key("drm-engine-gfx");
+    const fdinfo_key vram_key     = drm_clients.get_key("drm-memory-vram");
+    const fdinfo_key gtt_key      = drm_clients.get_key("drm-memory-gtt");
 
     bool metrics_available = false;
+    bool drm_available = false;
+
+    // generic names of sensors read with ioctls instead of sysfs
+    std::set<std::string, std::less<>> drm_sensors;
+    amdgpu_drm_base::sensor drm_power_sensor = amdgpu_drm_base::SENSOR_COUNT;
+
+    void enable_drm_sensor(amdgpu_drm_base::sensor s, const std::vector<std::string>& names);
+    bool is_drm_sensor(std::string_view name) const;
+    std::vector<hwmon_sensor> sysfs_only(const std::vector<hwmon_sensor>& list) const;
 
 public:
     AMDGPU(
@@ -71,8 +85,19 @@ public:
 
     int     get_fan_speed()                     override;
 
+    float   get_socket_power()                  override;
+    float   get_soc_power()                     override;
+
+    int     get_pcie_link_width()               override;
+    float   get_pcie_link_speed()               override;
+    float   get_pcie_bandwidth()                override;
+
+    uint8_t get_apu_cores(gpu_apu_core_t* out, uint8_t max) override;
+    void    get_samples(gpu_samples_t& samples) override;
+
     // Process-related functions
     int     get_process_load(pid_t pid)         override;
     float   get_process_vram_used(pid_t pid)    override;
     float   get_process_gtt_used(pid_t pid)     override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
 };
@@ -0,0 +1,158 @@
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+#include "amdgpu_drm.hpp"
+#include "../../common/log_errno.hpp"
+
+// not in older libdrm
+#ifndef AMDGPU_INFO_SENSOR_GPU_INPUT_POWER
+#define AMDGPU_INFO_SENSOR_GPU_INPUT_POWER 0xc
+#endif
+
+static const uint32_t sensor_types[amdgpu_drm_base::SENSOR_COUNT] = {
+    AMDGPU_INFO_SENSOR_GPU_LOAD,
+    AMDGPU_INFO_SENSOR_GFX_SCLK,
+    AMDGPU_INFO_SENSOR_GFX_MCLK,
+    AMDGPU_INFO_SENSOR_GPU_TEMP,
+    AMDGPU_INFO_SENSOR_VDDGFX,
+    AMDGPU_INFO_SENSOR_GPU_AVG_POWER,
+    AMDGPU_INFO_SENSOR_GPU_INPUT_POWER
+};
+
+static int amdgpu_ioctl(int fd, unsigned long request, void *arg) {
+    int ret;
+
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+
+    return ret;
+}
+
+static int amdgpu_query_info(int fd, uint32_t query, void* out, uint32_t size, uint32_t sensor_type = 0) {
+    struct drm_amdgpu_info request = {};
+
+    request.return_pointer = reinterpret_cast<uintptr_t>(out);
+    request.return_size = size;
+    request.query = query;
+    request.sensor_info.type = sensor_type;
+
+    return amdgpu_ioctl(fd, DRM_IOCTL_AMDGPU_INFO, &request);
+}
+
+amdgpu_drm_base::~amdgpu_drm_base() {
+    if (render_fd >= 0)
+        close(render_fd);
+
+    if (runtime_status_fd >= 0)
+        close(runtime_status_fd);
+}
+
+bool amdgpu_drm_base::setup(const std::string& drm_node) {
+    const std::string path = "/dev/dri/" + drm_node;
+    render_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+
+    if (render_fd < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to open {}.", path);
+        return false;
+    }
+
+    // missing on GPUs without runtime pm
+    const std::string status_path = "/sys/class/drm/" + drm_node + "/device/power/runtime_status";
+    runtime_status_fd = open(status_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    has_memory = query_memory();
+    SPDLOG_DEBUG("amdgpu_drm: memory info {}supported", has_memory ? "" : "not ");
+
+    return true;
+}
+
+bool amdgpu_drm_base::query_sensor(sensor s, uint32_t& out) {
+    return amdgpu_query_info(
+        render_fd, AMDGPU_INFO_SENSOR, &out, sizeof(out), sensor_types[s]
+    ) == 0;
+}
+
+bool amdgpu_drm_base::query_memory() {
+    return amdgpu_query_info(
+        render_fd, AMDGPU_INFO_MEMORY, &memory, sizeof(memory)
+    ) == 0;
+}
+
+bool amdgpu_drm_base::enable_sensor(sensor s) {
+    if (render_fd < 0)
+        return false;
+
+    enabled[s] = query_sensor(s, values[s]);
+
+    if (!enabled[s])
+        LOG_UNIX_ERRNO_DEBUG("amdgpu_drm: sensor {} is not supported.", sensor_types[s]);
+
+    return enabled[s];
+}
+
+bool amdgpu_drm_base::has_memory_info() const {
+    return has_memory;
+}
+
+bool amdgpu_drm_base::is_suspended() {
+    if (runtime_status_fd < 0)
+        return false;
+
+    char buf[16] = {};
+
+    if (pread(runtime_status_fd, buf, sizeof(buf) - 1, 0) <= 0)
+        return false;
+
+    return strncmp(buf, "suspended", 9) == 0;
+}
+
+void amdgpu_drm_base::poll() {
+    if (render_fd < 0)
+        return;
+
+    // don't wake GPU up just to see it idle
+    if (is_suspended()) {
+        for (uint32_t& v : values)
+            v = 0;
+
+        memory.vram.heap_usage = 0;
+        memory.gtt.heap_usage = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        if (!enabled[i])
+            continue;
+
+        if (!query_sensor(static_cast<sensor>(i), values[i])) {
+            SPDLOG_TRACE("amdgpu_drm: failed to read sensor {}", sensor_types[i]);
+            values[i] = 0;
+        }
+    }
+
+    if (has_memory && !query_memory())
+        SPDLOG_TRACE("amdgpu_drm: failed to read memory info");
+}
+
+uint32_t amdgpu_drm_base::get_sensor(sensor s) const {
+    return values[s];
+}
+
+uint64_t amdgpu_drm_base::get_vram_used() const {
+    return memory.vram.heap_usage;
+}
+
+uint64_t amdgpu_drm_base::get_gtt_used() const {
+    return memory.gtt.heap_usage;
+}
+
+uint64_t amdgpu_drm_base::get_vram_total() const {
+    return memory.vram.total_heap_size;
+}
+
+amdgpu_drm::amdgpu_drm() {}
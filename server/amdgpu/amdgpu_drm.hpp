@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include <libdrm/amdgpu_drm.h>
+
+// Sensors and memory usage read with DRM_IOCTL_AMDGPU_INFO on render node,
+// one ioctl per value instead of one sysfs file per value
+class amdgpu_drm_base {
+public:
+    enum sensor {
+        SENSOR_LOAD,            // %
+        SENSOR_CORE_CLOCK,      // MHz
+        SENSOR_MEMORY_CLOCK,    // MHz
+        SENSOR_TEMPERATURE,     // millidegrees celsius
+        SENSOR_VOLTAGE,         // mV
+        SENSOR_AVERAGE_POWER,   // W
+        SENSOR_INPUT_POWER,     // W
+        SENSOR_COUNT
+    };
+
+private:
+    int render_fd = -1;
+    // ioctls wake runtime suspended GPUs up, sysfs doesn't
+    int runtime_status_fd = -1;
+
+    bool enabled[SENSOR_COUNT] = {};
+    uint32_t values[SENSOR_COUNT] = {};
+
+    bool has_memory = false;
+    drm_amdgpu_memory_info memory = {};
+
+    bool query_sensor(sensor s, uint32_t& out);
+    bool query_memory();
+    bool is_suspended();
+
+public:
+    ~amdgpu_drm_base();
+    bool setup(const std::string& drm_node);
+
+    // query sensor on every poll, false if kernel doesn't support it
+    bool enable_sensor(sensor s);
+    bool has_memory_info() const;
+
+    void poll();
+
+    uint32_t get_sensor(sensor s) const;
+    uint64_t get_vram_used() const;
+    uint64_t get_gtt_used() const;
+    uint64_t get_vram_total() const;
+};
+
+struct amdgpu_drm {
+    amdgpu_drm_base drm;
+    amdgpu_drm();
+};
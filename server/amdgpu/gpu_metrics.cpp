@@ -1,16 +1,33 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include <spdlog/spdlog.h>
 #include "gpu_metrics.hpp"
+#include "../../common/log_errno.hpp"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 AMDGPUMetricsBase::AMDGPUMetricsBase(const std::string& drm_node) : drm_node(drm_node) {
 
 }
 
+AMDGPUMetricsBase::~AMDGPUMetricsBase() {
+    stop_sampler = true;
+
+    if (sampler.joinable())
+        sampler.join();
+
+    if (fd >= 0)
+        close(fd);
+}
+
 bool AMDGPUMetricsBase::setup() {
     // const std::string metrics_path = "/home/user/Desktop/projects/MangoHud/tests/gpu_metrics";
     const std::string metrics_path = "/sys/class/drm/" + drm_node + "/device/gpu_metrics";
-    ifs_gpu_metrics.open(metrics_path, std::ios::binary);
+    fd = open(metrics_path.c_str(), O_RDONLY | O_CLOEXEC);
 
-    if (!ifs_gpu_metrics.is_open()) {
+    if (fd < 0) {
         SPDLOG_WARN("Failed to open {}", metrics_path);
         return false;
     }
@@ -23,25 +40,191 @@ bool AMDGPUMetricsBase::setup() {
     return true;
 }
 
-void AMDGPUMetricsBase::poll() {
-    static std::vector<char> buf(max(sizeof(gpu_metrics_v1_3), sizeof(gpu_metrics_v2_4)));
-    const metrics_table_header* header = reinterpret_cast<metrics_table_header*>(buf.data());
+ssize_t AMDGPUMetricsBase::read_table() {
+    // sysfs regenerates the table on every read from offset 0
+    ssize_t len = pread(fd, &table, sizeof(table), 0);
+
+    if (len < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to read gpu_metrics of node '{}'.", drm_node);
+        return -1;
+    }
+
+    // older revisions are prefixes of newer ones,
+    // fields they don't have are read as 0
+    if (static_cast<size_t>(len) < sizeof(table))
+        memset(reinterpret_cast<char*>(&table) + len, 0, sizeof(table) - len);
+
+    return len;
+}
 
-    ifs_gpu_metrics.clear();
-    ifs_gpu_metrics.seekg(0);
-    ifs_gpu_metrics.read(reinterpret_cast<char*>(buf.data()), buf.size());
-    size_t bytes_read = ifs_gpu_metrics.gcount();
+// size of revisions which are decoded with their own struct,
+// 0 for the ones decoded with a struct of a newer revision
+static size_t expected_size(const metrics_table_header& header) {
+    switch (header.format_revision) {
+        case 1:
+            if (header.content_revision == 3) return sizeof(gpu_metrics_v1_3);
+            if (header.content_revision == 4) return sizeof(gpu_metrics_v1_4);
+            if (header.content_revision == 5) return sizeof(gpu_metrics_v1_5);
+            break;
+
+        case 2:
+            if (header.content_revision == 3) return sizeof(gpu_metrics_v2_3);
+            if (header.content_revision == 4) return sizeof(gpu_metrics_v2_4);
+            break;
 
+        case 3:
+            if (header.content_revision == 0) return sizeof(gpu_metrics_v3_0);
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+bool AMDGPUMetricsBase::verify_size(size_t bytes_read) {
     if (bytes_read < sizeof(metrics_table_header)) {
-        SPDLOG_DEBUG("Failed to read metrics header");
+        SPDLOG_DEBUG("Failed to read the metrics header of node '{}'", drm_node);
+        return false;
+    }
+
+    const metrics_table_header& header = table.header;
+
+    if (header.structure_size > bytes_read) {
+        SPDLOG_DEBUG(
+            "gpu_metrics of node '{}' is truncated: {} of {} bytes",
+            drm_node, bytes_read, header.structure_size
+        );
+        return false;
+    }
+
+    size_t size = expected_size(header);
+
+    if (size && header.structure_size != size) {
+        if (!size_warned)
+            SPDLOG_WARN(
+                "gpu_metrics v{}.{} of node '{}' has size {}, expected {}",
+                header.format_revision, header.content_revision,
+                drm_node, header.structure_size, size
+            );
+
+        size_warned = true;
+        return false;
+    }
+
+    return true;
+}
+
+void AMDGPUMetricsBase::poll() {
+    if (sampler.joinable()) {
+        publish_samples();
+        return;
+    }
+
+    if (read_metrics())
+        metrics = current;
+}
+
+void AMDGPUMetricsBase::start_sampling(std::chrono::milliseconds interval) {
+    sample_interval = interval;
+
+    // a poll's worth of samples, with some headroom for late polls
+    for (auto& w : window)
+        w.reserve(2 * 1000 / interval.count() + 1);
+
+    sampler = std::thread(&AMDGPUMetricsBase::sample, this);
+    pthread_setname_np(sampler.native_handle(), "amdgpu-sampler");
+
+    SPDLOG_INFO("Sampling gpu_metrics of node '{}' every {}ms", drm_node, interval.count());
+}
+
+void AMDGPUMetricsBase::sample() {
+    auto next = std::chrono::steady_clock::now();
+
+    while (!stop_sampler) {
+        if (read_metrics()) {
+            std::unique_lock lock(sample_mutex);
+            add_sample();
+        }
+
+        // don't try to catch up after a slow read
+        next = std::max(next + sample_interval, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void AMDGPUMetricsBase::add_sample() {
+    bool first = window[SAMPLE_LOAD].empty();
+
+    window[SAMPLE_LOAD].push_back(current.gpu_load_percent);
+    window[SAMPLE_CORE_CLOCK].push_back(current.current_gfxclk_mhz);
+    window[SAMPLE_MEMORY_CLOCK].push_back(current.current_uclk_mhz);
+    window[SAMPLE_POWER].push_back(current.average_gfx_power_w);
+    window[SAMPLE_TEMPERATURE].push_back(_is_apu ? current.apu_cpu_temp_c : current.gpu_temp_c);
+
+    // throttling anywhere in the window counts
+    bool power_throttled    = current.is_power_throttled    || (!first && latest.is_power_throttled);
+    bool current_throttled  = current.is_current_throttled  || (!first && latest.is_current_throttled);
+    bool temp_throttled     = current.is_temp_throttled     || (!first && latest.is_temp_throttled);
+    bool other_throttled    = current.is_other_throttled    || (!first && latest.is_other_throttled);
+
+    latest = current;
+    latest.is_power_throttled   = power_throttled;
+    latest.is_current_throttled = current_throttled;
+    latest.is_temp_throttled    = temp_throttled;
+    latest.is_other_throttled   = other_throttled;
+}
+
+// sorts values
+static void get_stats(std::vector<float>& values, gpu_sample_stats_t& out) {
+    float sum = 0.f;
+
+    for (float v : values)
+        sum += v;
+
+    std::sort(values.begin(), values.end());
+
+    out.min     = values.front();
+    out.max     = values.back();
+    out.mean    = sum / values.size();
+    out.p5      = values[(values.size() - 1) * 5 / 100];
+    out.p95     = values[(values.size() - 1) * 95 / 100];
+}
+
+void AMDGPUMetricsBase::publish_samples() {
+    std::unique_lock lock(sample_mutex);
+
+    // keep previous values if sampler didn't get anything
+    if (window[SAMPLE_LOAD].empty())
         return;
+
+    metrics = latest;
+    samples.num_of_samples = window[SAMPLE_LOAD].size();
+
+    gpu_sample_stats_t* stats[SAMPLE_VALUE_COUNT] = {
+        &samples.load, &samples.core_clock, &samples.memory_clock,
+        &samples.power_usage, &samples.temperature
+    };
+
+    for (size_t i = 0; i < SAMPLE_VALUE_COUNT; i++) {
+        get_stats(window[i], *stats[i]);
+        window[i].clear();
     }
+}
+
+bool AMDGPUMetricsBase::read_metrics() {
+    ssize_t bytes_read = read_table();
 
+    if (bytes_read < 0 || !verify_size(bytes_read))
+        return false;
+
+    const metrics_table_header& header = table.header;
     uint64_t indep_throttle_status = 0;
 
-    if (header->format_revision == 1) {
+    if (header.format_revision == 1 && header.content_revision <= 3) {
         // Desktop GPUs
-        const gpu_metrics_v1_3* amdgpu_metrics = reinterpret_cast<gpu_metrics_v1_3*>(buf.data());
+        const gpu_metrics_v1_3* amdgpu_metrics = &table.v1_3;
 
         parse_metrics_v1_3(amdgpu_metrics);
 
@@ -50,23 +233,37 @@ void AMDGPUMetricsBase::poll() {
         // RDNA 3 almost always shows the TEMP_HOTSPOT throtting flag,
         // so clear that bit
         indep_throttle_status &= ~(1ull << TEMP_HOTSPOT_BIT);
-    } else if (header->format_revision == 2) {
+    } else if (header.format_revision == 1) {
+        // Instinct GPUs, throttle status is parsed with the rest
+        if (header.content_revision == 4)
+            parse_metrics_v1_4(&table.v1_4);
+        else
+            parse_metrics_v1_5(&table.v1_5);
+
+        return true;
+    } else if (header.format_revision == 2) {
         // APUs
-        const gpu_metrics_v2_3* amdgpu_metrics = reinterpret_cast<gpu_metrics_v2_3*>(buf.data());
+        const gpu_metrics_v2_3* amdgpu_metrics = &table.v2_3;
 
-        parse_metrics_v2_3(amdgpu_metrics, header->content_revision);
+        parse_metrics_v2_3(amdgpu_metrics, header.content_revision);
 
-        if(header->content_revision >= 2)
+        if(header.content_revision >= 2)
             indep_throttle_status = amdgpu_metrics->indep_throttle_status;
+    } else if (header.format_revision == 3) {
+        // APUs, throttle residency is parsed with the rest
+        parse_metrics_v3_0(&table.v3_0);
+        return true;
     }
 
     /* Throttling: See
     https://elixir.bootlin.com/linux/latest/source/drivers/gpu/drm/amd/pm/swsmu/inc/amdgpu_smu.h
     for the offsets */
-    metrics.is_power_throttled      = ((indep_throttle_status >> 0)  & 0xFF  ) != 0;
-    metrics.is_current_throttled    = ((indep_throttle_status >> 16) & 0xFF  ) != 0;
-    metrics.is_temp_throttled       = ((indep_throttle_status >> 32) & 0xFFFF) != 0;
-    metrics.is_other_throttled      = ((indep_throttle_status >> 56) & 0xFF  ) != 0;
+    current.is_power_throttled      = ((indep_throttle_status >> 0)  & 0xFF  ) != 0;
+    current.is_current_throttled    = ((indep_throttle_status >> 16) & 0xFF  ) != 0;
+    current.is_temp_throttled       = ((indep_throttle_status >> 32) & 0xFFFF) != 0;
+    current.is_other_throttled      = ((indep_throttle_status >> 56) & 0xFF  ) != 0;
+
+    return true;
 }
 
 bool AMDGPUMetricsBase::is_apu() const {
@@ -74,21 +271,19 @@ bool AMDGPUMetricsBase::is_apu() const {
 }
 
 bool AMDGPUMetricsBase::verify_metrics() {
-    metrics_table_header header = {};
+    ssize_t bytes_read = read_table();
 
-    ifs_gpu_metrics.read(reinterpret_cast<char*>(&header), sizeof(header));
-
-    if (ifs_gpu_metrics.tellg() != sizeof(header)) {
-        SPDLOG_DEBUG("Failed to read the metrics header of node '{}'", drm_node);
+    if (bytes_read < 0 || !verify_size(bytes_read))
         return false;
-    }
+
+    const metrics_table_header& header = table.header;
 
     SPDLOG_DEBUG("gpu_metrics version: {}.{}", header.format_revision, header.content_revision);
 
     switch (header.format_revision) {
-        case 1: // v1_1, v1_2, v1_3
+        case 1: // v1_1, v1_2, v1_3, v1_4, v1_5
             // v1_0, not naturally aligned
-            if(header.content_revision == 0 || header.content_revision > 3)
+            if(header.content_revision == 0 || header.content_revision > 5)
                 break;
 
             return true;
@@ -102,6 +297,14 @@ bool AMDGPUMetricsBase::verify_metrics() {
 
             return true;
 
+        case 3: // v3_0
+            if(header.content_revision != 0)
+                break;
+
+            _is_apu = true;
+
+            return true;
+
         default:
             break;
     }
@@ -113,39 +316,87 @@ bool AMDGPUMetricsBase::verify_metrics() {
     return false;
 }
 
+static uint16_t valid_or_zero(uint16_t value) {
+    return IS_VALID_METRIC(value) ? value : 0;
+}
+
 void AMDGPUMetricsBase::parse_metrics_v1_3(const gpu_metrics_v1_3* in) {
-    metrics.gpu_load_percent    = in->average_gfx_activity;
+    current.gpu_load_percent    = in->average_gfx_activity;
 
-    metrics.average_gfx_power_w = in->average_socket_power;
+    current.average_gfx_power_w = in->average_socket_power;
+    current.average_socket_power_w = valid_or_zero(in->average_socket_power);
 
-    metrics.current_gfxclk_mhz  = in->current_gfxclk;
-    metrics.current_uclk_mhz    = in->current_uclk;
+    current.current_gfxclk_mhz  = in->current_gfxclk;
+    current.current_uclk_mhz    = in->current_uclk;
 
-    metrics.gpu_temp_c          = in->temperature_edge;
-    metrics.fan_speed           = in->current_fan_speed;
+    current.gpu_temp_c          = in->temperature_edge;
+    current.hotspot_temp_c      = valid_or_zero(in->temperature_hotspot);
+    current.mem_temp_c          = valid_or_zero(in->temperature_mem);
+    current.fan_speed           = in->current_fan_speed;
+
+    current.pcie_link_width     = valid_or_zero(in->pcie_link_width);
+    current.pcie_link_speed     = valid_or_zero(in->pcie_link_speed) / 10.f;
 }
 
-#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+// v1_4 and v1_5 only differ in the middle of the table
+template<typename T>
+static void parse_metrics_v1_4_common(const T* in, amdgpu_common_metrics& current) {
+    current.gpu_load_percent    = in->average_gfx_activity;
+
+    // no edge temperature on these
+    current.gpu_temp_c          = valid_or_zero(in->temperature_hotspot);
+    current.hotspot_temp_c      = valid_or_zero(in->temperature_hotspot);
+    current.mem_temp_c          = valid_or_zero(in->temperature_mem);
+
+    current.average_gfx_power_w = valid_or_zero(in->curr_socket_power);
+    current.average_socket_power_w = valid_or_zero(in->curr_socket_power);
+
+    current.current_gfxclk_mhz  = valid_or_zero(in->current_gfxclk[0]);
+    current.current_uclk_mhz    = valid_or_zero(in->current_uclk);
+
+    current.pcie_link_width     = valid_or_zero(in->pcie_link_width);
+    current.pcie_link_speed     = valid_or_zero(in->pcie_link_speed) / 10.f;
+    current.pcie_bandwidth      = in->pcie_bandwidth_inst;
+
+    // ASIC dependent bits, there is no ASIC independent status
+    current.is_power_throttled      = false;
+    current.is_current_throttled    = false;
+    current.is_temp_throttled       = false;
+    current.is_other_throttled      = in->throttle_status != 0;
+}
+
+void AMDGPUMetricsBase::parse_metrics_v1_4(const gpu_metrics_v1_4* in) {
+    parse_metrics_v1_4_common(in, current);
+}
+
+void AMDGPUMetricsBase::parse_metrics_v1_5(const gpu_metrics_v1_5* in) {
+    parse_metrics_v1_4_common(in, current);
+}
 
 void AMDGPUMetricsBase::parse_metrics_v2_3(const gpu_metrics_v2_3* in, uint8_t content_revision) {
-    metrics.gpu_load_percent = in->average_gfx_activity;
-    metrics.average_gfx_power_w = in->average_gfx_power / 1000.f;
+    current.gpu_load_percent = in->average_gfx_activity;
+    current.average_gfx_power_w = in->average_gfx_power / 1000.f;
 
     if (IS_VALID_METRIC(in->average_cpu_power)) {
-        metrics.average_cpu_power_w = in->average_cpu_power / 1000.f;
+        current.average_cpu_power_w = in->average_cpu_power / 1000.f;
     } else if (IS_VALID_METRIC(in->average_core_power[0])) {
         // fallback: sum of core power
         uint8_t i = 0;
 
+        current.average_cpu_power_w = 0;
+
         do {
-            metrics.average_cpu_power_w = metrics.average_cpu_power_w + in->average_core_power[i] / 1000.f;
+            current.average_cpu_power_w = current.average_cpu_power_w + in->average_core_power[i] / 1000.f;
         } while (++i < ARRAY_SIZE(in->average_core_power) && IS_VALID_METRIC(in->average_core_power[i]));
     }
 
+    current.average_socket_power_w = valid_or_zero(in->average_socket_power) / 1000.f;
+    current.average_soc_power_w = valid_or_zero(in->average_soc_power) / 1000.f;
+
     if (IS_VALID_METRIC(in->temperature_gfx))
-        metrics.gpu_temp_c = in->temperature_gfx / 100;
+        current.gpu_temp_c = in->temperature_gfx / 100;
     else if (content_revision >= 3 && IS_VALID_METRIC(in->average_temperature_gfx))
-        metrics.gpu_temp_c = in->average_temperature_gfx / 100;
+        current.gpu_temp_c = in->average_temperature_gfx / 100;
 
     uint16_t cpu_temp = 0;
 
@@ -156,7 +407,7 @@ void AMDGPUMetricsBase::parse_metrics_v2_3(const gpu_metrics_v2_3* in, uint8_t c
             cpu_temp = max(cpu_temp, in->temperature_core[i]);
         } while (++i < ARRAY_SIZE(in->temperature_core) && IS_VALID_METRIC(in->temperature_core[i]));
 
-        metrics.apu_cpu_temp_c = cpu_temp / 100;
+        current.apu_cpu_temp_c = cpu_temp / 100;
     } else if (content_revision >= 3 && IS_VALID_METRIC(in->average_temperature_core[0]) ) {
         uint8_t i = 0;
 
@@ -164,24 +415,89 @@ void AMDGPUMetricsBase::parse_metrics_v2_3(const gpu_metrics_v2_3* in, uint8_t c
             cpu_temp = max(cpu_temp, in->average_temperature_core[i]);
         } while (++i < ARRAY_SIZE(in->average_temperature_core) && IS_VALID_METRIC(in->average_temperature_core[i]));
 
-        metrics.apu_cpu_temp_c = cpu_temp / 100;
+        current.apu_cpu_temp_c = cpu_temp / 100;
     }/* else if( cpuStats.ReadcpuTempFile(cpu_temp) ) {
     // fallback 2: Try temp from file 'm_cpuTempFile' of 'cpu.cpp'
     metrics.apu_cpu_temp_c = cpu_temp;
     }*/
 
     if (IS_VALID_METRIC(in->current_gfxclk))
-        metrics.current_gfxclk_mhz = in->current_gfxclk;
+        current.current_gfxclk_mhz = in->current_gfxclk;
     else if (IS_VALID_METRIC(in->average_gfxclk_frequency))
-        metrics.current_gfxclk_mhz = in->average_gfxclk_frequency;
+        current.current_gfxclk_mhz = in->average_gfxclk_frequency;
 
     if (IS_VALID_METRIC(in->current_uclk))
-        metrics.current_uclk_mhz = in->current_uclk;
+        current.current_uclk_mhz = in->current_uclk;
     else if (IS_VALID_METRIC(in->average_uclk_frequency))
-        metrics.current_uclk_mhz = in->average_uclk_frequency;
+        current.current_uclk_mhz = in->average_uclk_frequency;
+
+    // cores with invalid clock are not there
+    current.num_of_cores = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(in->current_coreclk); i++) {
+        if (!IS_VALID_METRIC(in->current_coreclk[i]))
+            break;
+
+        uint16_t temp = in->temperature_core[i];
+
+        if (!IS_VALID_METRIC(temp) && content_revision >= 3)
+            temp = in->average_temperature_core[i];
+
+        current.core_clock_mhz[i] = in->current_coreclk[i];
+        current.core_temp_c[i] = valid_or_zero(temp) / 100;
+        current.num_of_cores++;
+    }
+}
+
+void AMDGPUMetricsBase::parse_metrics_v3_0(const gpu_metrics_v3_0* in) {
+    current.gpu_load_percent = in->average_gfx_activity;
+
+    current.average_gfx_power_w = in->average_gfx_power / 1000.f;
+    current.average_cpu_power_w = in->average_all_core_power / 1000.f;
+    current.average_socket_power_w = in->average_socket_power / 1000.f;
+
+    current.gpu_temp_c = valid_or_zero(in->temperature_gfx) / 100;
+    current.soc_temp_c = valid_or_zero(in->temperature_soc) / 100;
+
+    current.current_gfxclk_mhz = valid_or_zero(in->average_gfxclk_frequency);
+    current.current_uclk_mhz = valid_or_zero(in->average_uclk_frequency);
+
+    uint16_t cpu_temp = 0;
+    current.num_of_cores = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(in->current_coreclk); i++) {
+        if (!IS_VALID_METRIC(in->current_coreclk[i]))
+            break;
+
+        uint16_t temp = valid_or_zero(in->temperature_core[i]);
+        cpu_temp = max(cpu_temp, temp);
+
+        current.core_clock_mhz[i] = in->current_coreclk[i];
+        current.core_temp_c[i] = temp / 100;
+        current.num_of_cores++;
+    }
+
+    current.apu_cpu_temp_c = cpu_temp / 100;
+
+    // residency only grows, throttled if it changed since previous poll
+    uint32_t residency_power =
+        in->throttle_residency_spl + in->throttle_residency_fppt +
+        in->throttle_residency_sppt;
+    uint32_t residency_temp =
+        in->throttle_residency_prochot + in->throttle_residency_thm_core +
+        in->throttle_residency_thm_gfx + in->throttle_residency_thm_soc;
+
+    current.is_power_throttled      = has_residency && residency_power != previous_residency_power;
+    current.is_current_throttled    = false;
+    current.is_temp_throttled       = has_residency && residency_temp != previous_residency_temp;
+    current.is_other_throttled      = false;
+
+    has_residency = true;
+    previous_residency_power = residency_power;
+    previous_residency_temp = residency_temp;
 }
 
 #undef ARRAY_SIZE
 
 AMDGPUMetrics::AMDGPUMetrics(const std::string& drm_node)
-    : gpu_metrics(AMDGPUMetricsBase(drm_node)) {}
+    : gpu_metrics(drm_node) {}
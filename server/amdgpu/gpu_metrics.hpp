@@ -1,10 +1,21 @@
 #pragma once
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <string>
-#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "../../common/gpu_metrics.hpp"
 
 #define NUM_HBM_INSTANCES 4
+#define NUM_VCN 4
+#define NUM_JPEG_ENG 32
+#define NUM_XGMI_LINKS 8
+#define MAX_GFX_CLKS 8
+#define MAX_CLKS 4
 #define TEMP_HOTSPOT_BIT 36ull
 #define IS_VALID_METRIC(FIELD) (FIELD != 0xffff)
 
@@ -109,6 +120,157 @@ struct gpu_metrics_v1_3 {
 	uint64_t			indep_throttle_status;
 };
 
+struct gpu_metrics_v1_4 {
+	struct metrics_table_header	common_header;
+
+	/* Temperature (Celsius) */
+	uint16_t			temperature_hotspot;
+	uint16_t			temperature_mem;
+	uint16_t			temperature_vrsoc;
+
+	/* Power (Watts) */
+	uint16_t			curr_socket_power;
+
+	/* Utilization (%) */
+	uint16_t			average_gfx_activity;
+	uint16_t			average_umc_activity; // memory controller
+	uint16_t			vcn_activity[NUM_VCN];
+
+	/* Energy (15.259uJ (2^-16) units) */
+	uint64_t			energy_accumulator;
+
+	/* Driver attached timestamp (in ns) */
+	uint64_t			system_clock_counter;
+
+	/* Throttle status */
+	uint32_t			throttle_status;
+
+	/* Clock Lock Status. Each bit corresponds to clock instance */
+	uint32_t			gfxclk_lock_status;
+
+	/* Link width (number of lanes) and speed (in 0.1 GT/s) */
+	uint16_t			pcie_link_width;
+	uint16_t			pcie_link_speed;
+
+	/* XGMI bus width and bitrate (in Gbps) */
+	uint16_t			xgmi_link_width;
+	uint16_t			xgmi_link_speed;
+
+	/* Utilization Accumulated (%) */
+	uint32_t			gfx_activity_acc;
+	uint32_t			mem_activity_acc;
+
+	/* PCIE accumulated bandwidth (GB/sec) */
+	uint64_t			pcie_bandwidth_acc;
+
+	/* PCIE instantaneous bandwidth (GB/sec) */
+	uint64_t			pcie_bandwidth_inst;
+
+	/* PCIE L0 to recovery state transition accumulated count */
+	uint64_t			pcie_l0_to_recov_count_acc;
+
+	/* PCIE replay accumulated count */
+	uint64_t			pcie_replay_count_acc;
+
+	/* PCIE replay rollover accumulated count */
+	uint64_t			pcie_replay_rover_count_acc;
+
+	/* XGMI accumulated data transfer size(KiloBytes) */
+	uint64_t			xgmi_read_data_acc[NUM_XGMI_LINKS];
+	uint64_t			xgmi_write_data_acc[NUM_XGMI_LINKS];
+
+	/* PMFW attached timestamp (10ns resolution) */
+	uint64_t			firmware_timestamp;
+
+	/* Current clocks (Mhz) */
+	uint16_t			current_gfxclk[MAX_GFX_CLKS];
+	uint16_t			current_socclk[MAX_CLKS];
+	uint16_t			current_vclk0[MAX_CLKS];
+	uint16_t			current_dclk0[MAX_CLKS];
+	uint16_t			current_uclk;
+
+	uint16_t			padding;
+};
+
+struct gpu_metrics_v1_5 {
+	struct metrics_table_header	common_header;
+
+	/* Temperature (Celsius) */
+	uint16_t			temperature_hotspot;
+	uint16_t			temperature_mem;
+	uint16_t			temperature_vrsoc;
+
+	/* Power (Watts) */
+	uint16_t			curr_socket_power;
+
+	/* Utilization (%) */
+	uint16_t			average_gfx_activity;
+	uint16_t			average_umc_activity; // memory controller
+	uint16_t			vcn_activity[NUM_VCN];
+	uint16_t			jpeg_activity[NUM_JPEG_ENG];
+
+	/* Energy (15.259uJ (2^-16) units) */
+	uint64_t			energy_accumulator;
+
+	/* Driver attached timestamp (in ns) */
+	uint64_t			system_clock_counter;
+
+	/* Throttle status */
+	uint32_t			throttle_status;
+
+	/* Clock Lock Status. Each bit corresponds to clock instance */
+	uint32_t			gfxclk_lock_status;
+
+	/* Link width (number of lanes) and speed (in 0.1 GT/s) */
+	uint16_t			pcie_link_width;
+	uint16_t			pcie_link_speed;
+
+	/* XGMI bus width and bitrate (in Gbps) */
+	uint16_t			xgmi_link_width;
+	uint16_t			xgmi_link_speed;
+
+	/* Utilization Accumulated (%) */
+	uint32_t			gfx_activity_acc;
+	uint32_t			mem_activity_acc;
+
+	/* PCIE accumulated bandwidth (GB/sec) */
+	uint64_t			pcie_bandwidth_acc;
+
+	/* PCIE instantaneous bandwidth (GB/sec) */
+	uint64_t			pcie_bandwidth_inst;
+
+	/* PCIE L0 to recovery state transition accumulated count */
+	uint64_t			pcie_l0_to_recov_count_acc;
+
+	/* PCIE replay accumulated count */
+	uint64_t			pcie_replay_count_acc;
+
+	/* PCIE replay rollover accumulated count */
+	uint64_t			pcie_replay_rover_count_acc;
+
+	/* PCIE NAK sent accumulated count */
+	uint32_t			pcie_nak_sent_count_acc;
+
+	/* PCIE NAK received accumulated count */
+	uint32_t			pcie_nak_rcvd_count_acc;
+
+	/* XGMI accumulated data transfer size(KiloBytes) */
+	uint64_t			xgmi_read_data_acc[NUM_XGMI_LINKS];
+	uint64_t			xgmi_write_data_acc[NUM_XGMI_LINKS];
+
+	/* PMFW attached timestamp (10ns resolution) */
+	uint64_t			firmware_timestamp;
+
+	/* Current clocks (Mhz) */
+	uint16_t			current_gfxclk[MAX_GFX_CLKS];
+	uint16_t			current_socclk[MAX_CLKS];
+	uint16_t			current_vclk0[MAX_CLKS];
+	uint16_t			current_dclk0[MAX_CLKS];
+	uint16_t			current_uclk;
+
+	uint16_t			padding;
+};
+
 struct gpu_metrics_v2_3 {
 	struct metrics_table_header	common_header;
 
@@ -238,6 +400,89 @@ struct gpu_metrics_v2_4 {
 	uint16_t			average_gfx_current;
 };
 
+struct gpu_metrics_v3_0 {
+	struct metrics_table_header	common_header;
+
+	/* Temperature (unit: centi-Celsius) */
+	uint16_t			temperature_gfx;
+	uint16_t			temperature_soc;
+	uint16_t			temperature_core[16];
+	uint16_t			temperature_skin;
+
+	/* Utilization (unit: %) */
+	uint16_t			average_gfx_activity;
+	uint16_t			average_vcn_activity;
+	uint16_t			average_ipu_activity[8];
+	uint16_t			average_core_c0_activity[16];
+
+	/* DRAM/IPU bandwidth (unit: MB/s) */
+	uint16_t			average_dram_reads;
+	uint16_t			average_dram_writes;
+	uint16_t			average_ipu_reads;
+	uint16_t			average_ipu_writes;
+
+	/* Driver attached timestamp (in ns) */
+	uint64_t			system_clock_counter;
+
+	/* Power/Energy (unit: mW) */
+	uint32_t			average_socket_power; // APU + dGPU
+	uint16_t			average_ipu_power;
+	uint32_t			average_apu_power;
+	uint32_t			average_gfx_power;
+	uint32_t			average_dgpu_power;
+	uint32_t			average_all_core_power;
+	uint16_t			average_core_power[16];
+	uint16_t			average_sys_power;
+	uint16_t			stapm_power_limit;
+	uint16_t			current_stapm_power_limit;
+
+	/* Average clocks (unit: MHz) */
+	uint16_t			average_gfxclk_frequency;
+	uint16_t			average_socclk_frequency;
+	uint16_t			average_vpeclk_frequency;
+	uint16_t			average_ipuclk_frequency;
+	uint16_t			average_fclk_frequency;
+	uint16_t			average_vclk_frequency;
+	uint16_t			average_uclk_frequency;
+	uint16_t			average_mpipu_frequency;
+
+	/* Current clocks (unit: MHz) */
+	uint16_t			current_coreclk[16];
+	uint16_t			current_core_maxfreq;
+	uint16_t			current_gfx_maxfreq;
+
+	/* Throttle residency (ASIC dependent) */
+	uint32_t			throttle_residency_prochot;
+	uint32_t			throttle_residency_spl;
+	uint32_t			throttle_residency_fppt;
+	uint32_t			throttle_residency_sppt;
+	uint32_t			throttle_residency_thm_core;
+	uint32_t			throttle_residency_thm_gfx;
+	uint32_t			throttle_residency_thm_soc;
+
+	/* Metrics table alpha filter time constant (unit: us) */
+	uint32_t			time_filter_alphavalue;
+};
+
+// every table revision, read in place
+union gpu_metrics_table {
+	struct metrics_table_header	header;
+	struct gpu_metrics_v1_3		v1_3;
+	struct gpu_metrics_v1_4		v1_4;
+	struct gpu_metrics_v1_5		v1_5;
+	struct gpu_metrics_v2_3		v2_3;
+	struct gpu_metrics_v2_4		v2_4;
+	struct gpu_metrics_v3_0		v3_0;
+};
+
+// sizes of kernel structs, verify_size() rejects tables of other size
+static_assert(sizeof(gpu_metrics_v1_3) == 120);
+static_assert(sizeof(gpu_metrics_v1_4) == 288);
+static_assert(sizeof(gpu_metrics_v1_5) == 360);
+static_assert(sizeof(gpu_metrics_v2_3) == 152);
+static_assert(sizeof(gpu_metrics_v2_4) == 168);
+static_assert(sizeof(gpu_metrics_v3_0) == 264);
+
 struct amdgpu_common_metrics {
 	/* Load level: averaged across the sampling period */
 	uint16_t gpu_load_percent;
@@ -262,24 +507,96 @@ struct amdgpu_common_metrics {
 	bool is_other_throttled;
 
 	uint16_t fan_speed;
+
+	/* Power usage of whole package and of SoC */
+	float average_socket_power_w;
+	float average_soc_power_w;
+
+	/* Temperatures of dGPUs */
+	uint16_t hotspot_temp_c;
+	uint16_t mem_temp_c;
+
+	/* PCIe link: speed in GT/s, bandwidth in GB/s */
+	uint16_t pcie_link_width;
+	float pcie_link_speed;
+	float pcie_bandwidth;
+
+	/* CPU cores of APUs */
+	uint8_t num_of_cores;
+	uint16_t core_clock_mhz[16];
+	uint16_t core_temp_c[16];
 };
 
 class AMDGPUMetricsBase {
 public:
     explicit AMDGPUMetricsBase(const std::string& drm_node);
+    ~AMDGPUMetricsBase();
+
+    AMDGPUMetricsBase(const AMDGPUMetricsBase&) = delete;
+    AMDGPUMetricsBase& operator=(const AMDGPUMetricsBase&) = delete;
+
     bool setup();
     void poll();
 	bool is_apu() const;
     amdgpu_common_metrics metrics = {};
 
+    // Reads the table every interval from own thread, SMU updates it
+    // much more often than once per poll. poll() then publishes the
+    // latest sample and stats of all samples since previous poll.
+    void start_sampling(std::chrono::milliseconds interval);
+    gpu_samples_t samples = {};
+
 private:
 	bool _is_apu = false;
     const std::string drm_node;
-    std::ifstream ifs_gpu_metrics;
+    int fd = -1;
+
+    // per device, so GPU threads don't share it. Naturally aligned
+    // for the 64-bit fields, tables are read into it in place.
+    gpu_metrics_table table = {};
+    bool size_warned = false;
+
+    // v3.0 reports time spent throttled instead of throttle status
+    bool has_residency = false;
+    uint32_t previous_residency_power = 0;
+    uint32_t previous_residency_temp = 0;
+
+    // parsed by read_metrics(), copied to metrics by poll()
+    amdgpu_common_metrics current = {};
+
+    enum sampled_value {
+        SAMPLE_LOAD,
+        SAMPLE_CORE_CLOCK,
+        SAMPLE_MEMORY_CLOCK,
+        SAMPLE_POWER,
+        SAMPLE_TEMPERATURE,
+        SAMPLE_VALUE_COUNT
+    };
+
+    std::thread sampler;
+    std::atomic<bool> stop_sampler = false;
+    std::chrono::milliseconds sample_interval;
+
+    // samples since previous poll, guarded by sample_mutex
+    std::mutex sample_mutex;
+    std::vector<float> window[SAMPLE_VALUE_COUNT];
+    // most recent sample, with throttling of the whole window
+    amdgpu_common_metrics latest = {};
+
+    void sample();
+    void add_sample();
+    void publish_samples();
+
+    ssize_t read_table();
+    bool read_metrics();
     bool verify_metrics();
+    bool verify_size(size_t bytes_read);
 
 	void parse_metrics_v1_3(const gpu_metrics_v1_3* in);
+	void parse_metrics_v1_4(const gpu_metrics_v1_4* in);
+	void parse_metrics_v1_5(const gpu_metrics_v1_5* in);
 	void parse_metrics_v2_3(const gpu_metrics_v2_3* in, uint8_t content_revision);
+	void parse_metrics_v3_0(const gpu_metrics_v3_0* in);
 };
 
 struct AMDGPUMetrics {
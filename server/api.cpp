@@ -39,9 +39,39 @@ std::string form_json_response() {
             { "frequency"    , m.cores[i].frequency }
         });
     }
+
+    for (uint8_t i = 0; i < m.num_of_power_domains; i++) {
+        j["cpu"]["power_domains"].push_back({
+            { "name"         , m.power_domains[i].name      },
+            { "power"        , m.power_domains[i].power     },
+            { "energy_uj"    , m.power_domains[i].energy_uj }
+        });
+    }
     // ====END CPU INFO=============================================================
 
     // ====START GPU INFO===========================================================
+    // engine name -> load
+    auto engines_json = [](const gpu_engines_t& e) {
+        json r = json::object();
+
+        for (uint8_t i = 0; i < e.num_of_engines; i++)
+            r[e.engines[i].name] = e.engines[i].load;
+
+        return r;
+    };
+
+    auto sample_stats_json = [](const gpu_sample_stats_t& s) {
+        return json {
+            { "min", s.min },
+            { "max", s.max },
+            { "mean", s.mean },
+            { "p5", s.p5 },
+            { "p95", s.p95 }
+        };
+    };
+
+    const char* gpu_event_types[GPU_EVENT_TYPE_COUNT] = { "throttle", "xid", "power_source" };
+
     for (uint16_t i = 0; i < m.num_of_gpus; i++) {
         gpu_metrics_system_t& g = m.gpus[i];
 
@@ -74,8 +104,62 @@ std::string form_json_response() {
             METRIC(is_other_throttled),
 
             METRIC(fan_speed),
-            METRIC(fan_rpm)
+            METRIC(fan_rpm),
+
+            METRIC(socket_power),
+            METRIC(soc_power),
+
+            METRIC(pcie_link_width),
+            METRIC(pcie_link_speed),
+            METRIC(pcie_bandwidth),
+
+            METRIC(requested_clock),
+            METRIC(idle_residency)
         });
+
+        j["gpu"].back()["engines"] = engines_json(g.engines);
+        j["gpu"].back()["top_clients"] = json::array();
+
+        for (uint8_t c = 0; c < g.num_of_top_clients; c++) {
+            const gpu_client_t& client = g.top_clients[c];
+
+            j["gpu"].back()["top_clients"].push_back({
+                { "pid", client.pid },
+                { "name", client.name },
+                { "load", client.load },
+                { "vram_used", client.vram_used },
+                { "gtt_used", client.gtt_used }
+            });
+        }
+
+        j["gpu"].back()["events"] = json::array();
+
+        for (uint8_t e = 0; e < g.num_of_events; e++) {
+            const gpu_event_t& event = g.events[e];
+
+            j["gpu"].back()["events"].push_back({
+                { "timestamp_ns", event.timestamp_ns },
+                { "type", gpu_event_types[event.type] },
+                { "data", event.data }
+            });
+        }
+
+        j["gpu"].back()["apu_cores"] = json::array();
+
+        for (uint8_t c = 0; c < g.num_of_apu_cores; c++)
+            j["gpu"].back()["apu_cores"].push_back({
+                { "clock", g.apu_cores[c].clock },
+                { "temp", g.apu_cores[c].temp }
+            });
+
+        j["gpu"].back()["samples"] = {
+            { "count", g.samples.num_of_samples },
+            { "load", sample_stats_json(g.samples.load) },
+            { "core_clock", sample_stats_json(g.samples.core_clock) },
+            { "memory_clock", sample_stats_json(g.samples.memory_clock) },
+            { "power_usage", sample_stats_json(g.samples.power_usage) },
+            { "temperature", sample_stats_json(g.samples.temperature) }
+        };
     }
     // ====END GPU INFO=============================================================
 
@@ -84,15 +168,80 @@ std::string form_json_response() {
         { "used", m.memory.used },
         { "total", m.memory.total },
         { "swap_used", m.memory.swap_used },
+
+        { "cached", m.memory.cached },
+        { "buffers", m.memory.buffers },
+        { "dirty", m.memory.dirty },
+        { "writeback", m.memory.writeback },
+        { "anon", m.memory.anon },
+        { "shmem", m.memory.shmem },
+
+        { "anon_hugepages", m.memory.anon_hugepages },
+        { "hugetlb_total", m.memory.hugetlb_total },
+        { "hugetlb_free", m.memory.hugetlb_free },
+
+        { "zswap", m.memory.zswap },
+        { "zswapped", m.memory.zswapped },
+
+        { "committed", m.memory.committed },
+        { "commit_limit", m.memory.commit_limit },
+    };
+
+    j["vmstat"] = {
+        { "pswpin", m.vmstat.pswpin },
+        { "pswpout", m.vmstat.pswpout },
+        { "pgmajfault", m.vmstat.pgmajfault },
+        { "compact_stall", m.vmstat.compact_stall },
+        { "allocstall", m.vmstat.allocstall },
+        { "thp_fault_fallback", m.vmstat.thp_fault_fallback },
+        { "workingset_refault", m.vmstat.workingset_refault },
     };
     // ====END MEMORY INFO==========================================================
 
+    // ====START PRESSURE INFO======================================================
+    const char* psi_resources[PSI_RESOURCE_COUNT] = { "cpu", "memory", "io" };
+
+    auto pressure_json = [&](const pressure_t& p) {
+        json r;
+
+        for (uint8_t i = 0; i < PSI_RESOURCE_COUNT; i++) {
+            const pressure_stall_t& s = p.resources[i];
+
+            r[psi_resources[i]] = {
+                { "some_avg10", s.some_avg10 },
+                { "full_avg10", s.full_avg10 },
+                { "some_total_us", s.some_total_us },
+                { "full_total_us", s.full_total_us },
+            };
+        }
+
+        return r;
+    };
+
+    j["pressure"] = pressure_json(m.pressure);
+    j["pressure"]["stall_events"] = json::array();
+
+    for (uint8_t i = 0; i < m.num_of_stall_events; i++) {
+        const stall_event_t& e = m.stall_events[i];
+
+        j["pressure"]["stall_events"].push_back({
+            { "timestamp_ns", e.timestamp_ns },
+            { "resource", psi_resources[e.resource] },
+            { "some_total_us", e.some_total_us },
+        });
+    }
+    // ====END PRESSURE INFO========================================================
+
     // ====START CLIENTS INFO=======================================================
     for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
         pid_t pid = proc.first;
         std::string s_pid = std::to_string(pid);
         process_metrics& p = proc.second;
 
+        // members of client process groups are reported in client's "group"
+        if (!p.is_client)
+            continue;
+
         for (uint16_t i = 0; i < m.num_of_gpus; i++) {
             gpu_metrics_process_t g = p.gpus[i];
 
@@ -101,18 +250,105 @@ std::string form_json_response() {
                 METRIC(vram_used),
                 METRIC(gtt_used)
             });
+
+            j["clients"][s_pid]["gpu"].back()["engines"] = engines_json(g.engines);
         }
 
+        j["clients"][s_pid]["cpu"] = {
+            { "load", p.cpu.load },
+            { "run_delay", p.cpu.run_delay },
+            { "voluntary_switches_per_sec", p.cpu.voluntary_switches_per_sec },
+            { "involuntary_switches_per_sec", p.cpu.involuntary_switches_per_sec },
+            { "threads", json::array() },
+            { "delayed_threads", json::array() }
+        };
+
+        auto thread_json = [](const thread_info_t& t) {
+            return json {
+                { "name", t.name },
+                { "tid", t.tid },
+                { "load", t.load },
+                { "cpu", t.cpu },
+                { "run_delay", t.run_delay },
+                { "voluntary_switches_per_sec", t.voluntary_switches_per_sec },
+                { "involuntary_switches_per_sec", t.involuntary_switches_per_sec },
+            };
+        };
+
+        for (uint8_t i = 0; i < p.cpu.num_of_threads; i++)
+            j["clients"][s_pid]["cpu"]["threads"].push_back(thread_json(p.cpu.threads[i]));
+
+        for (uint8_t i = 0; i < p.cpu.num_of_delayed_threads; i++)
+            j["clients"][s_pid]["cpu"]["delayed_threads"].push_back(thread_json(p.cpu.delayed_threads[i]));
+
         j["clients"][s_pid]["memory"] = {
             { "resident", p.memory.resident },
             { "shared", p.memory.shared },
             { "virt", p.memory.virt },
+
+            { "pss", p.memory.pss },
+            { "swap", p.memory.swap },
+            { "anon", p.memory.anon },
+            { "file", p.memory.file },
+
+            { "minor_faults_per_sec", p.memory.minor_faults_per_sec },
+            { "major_faults_per_sec", p.memory.major_faults_per_sec },
         };
 
         j["clients"][s_pid]["io"] = {
             { "read_mb_per_sec", p.io_stats.read_mb_per_sec },
             { "write_mb_per_sec", p.io_stats.write_mb_per_sec },
         };
+
+        j["clients"][s_pid]["cgroup_pressure"] = pressure_json(p.cgroup_pressure);
+
+        if (p.cgroup.valid) {
+            j["clients"][s_pid]["cgroup"] = {
+                { "cpu_load", p.cgroup.cpu_load },
+                { "throttled_ms_per_sec", p.cgroup.throttled_ms_per_sec },
+                { "nr_throttled", p.cgroup.nr_throttled },
+
+                { "memory_current", p.cgroup.memory_current },
+                { "memory_anon", p.cgroup.memory_anon },
+                { "memory_file", p.cgroup.memory_file },
+                { "memory_shmem", p.cgroup.memory_shmem },
+                { "memory_kernel", p.cgroup.memory_kernel },
+                { "major_faults_per_sec", p.cgroup.major_faults_per_sec },
+                { "workingset_refault_per_sec", p.cgroup.workingset_refault_per_sec },
+
+                { "read_mb_per_sec", p.cgroup.read_mb_per_sec },
+                { "write_mb_per_sec", p.cgroup.write_mb_per_sec },
+
+                { "memory_high_events", p.cgroup.memory_high_events },
+                { "memory_max_events", p.cgroup.memory_max_events },
+                { "oom_events", p.cgroup.oom_events },
+                { "oom_kill_events", p.cgroup.oom_kill_events },
+            };
+        }
+
+        if (p.group.num_of_processes > 0) {
+            j["clients"][s_pid]["group"] = {
+                { "num_of_processes", p.group.num_of_processes },
+                { "cpu_load", p.group.cpu_load },
+                { "resident", p.group.resident },
+                { "pss", p.group.pss },
+                { "swap", p.group.swap },
+                { "read_mb_per_sec", p.group.read_mb_per_sec },
+                { "write_mb_per_sec", p.group.write_mb_per_sec },
+            };
+
+            for (uint16_t i = 0; i < m.num_of_gpus; i++) {
+                gpu_metrics_process_t g = p.group.gpus[i];
+
+                j["clients"][s_pid]["group"]["gpu"].push_back({
+                    METRIC(load),
+                    METRIC(vram_used),
+                    METRIC(gtt_used)
+                });
+
+                j["clients"][s_pid]["group"]["gpu"].back()["engines"] = engines_json(g.engines);
+            }
+        }
     }
     // ====END CLIENTS INFO=========================================================
 
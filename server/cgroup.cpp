@@ -0,0 +1,234 @@
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "cgroup.hpp"
+#include "../common/log_errno.hpp"
+
+const char* const CgroupStats::file_names[CGROUP_FILE_COUNT] = {
+    "cpu.stat",
+    "memory.current",
+    "memory.stat",
+    "memory.events",
+    "io.stat"
+};
+
+// calls f(key, value) for every "key value" line
+template <typename F>
+static void for_each_key_value(const char* buf, F f) {
+    for (const char* line = buf; line && *line;) {
+        const char* space = std::strchr(line, ' ');
+        const char* eol = std::strchr(line, '\n');
+
+        if (space && (!eol || space < eol))
+            f(std::string_view(line, space - line), std::strtoull(space + 1, nullptr, 10));
+
+        line = eol ? eol + 1 : nullptr;
+    }
+}
+
+static float rate(uint64_t current, uint64_t previous, float seconds) {
+    if (seconds <= 0.f || current < previous)
+        return 0.f;
+
+    return (current - previous) / seconds;
+}
+
+CgroupStats::group::~group() {
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+}
+
+void CgroupStats::open_group(group& g) {
+    for (int i = 0; i < CGROUP_FILE_COUNT; i++) {
+        std::string path = g.path + "/" + file_names[i];
+        g.fds[i] = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        // controller may be disabled for this cgroup
+        if (g.fds[i] < 0)
+            LOG_UNIX_ERRNO_DEBUG("cgroup: failed to open \"{}\".", path);
+    }
+}
+
+void CgroupStats::add_pid(const ProcessHandle& process) {
+    if (pids.find(process.pid) != pids.end())
+        return;
+
+    std::string cgroup = process.get_cgroup();
+
+    // root cgroup has no cpu.stat/memory.current of its own,
+    // system-wide values are reported separately
+    if (cgroup.empty() || cgroup == "/")
+        return;
+
+    auto it = groups.find(cgroup);
+
+    if (it == groups.end()) {
+        it = groups.try_emplace(cgroup).first;
+        it->second.path = cgroup_root + cgroup;
+        open_group(it->second);
+
+        SPDLOG_DEBUG("cgroup: watching \"{}\"", it->second.path);
+    }
+
+    it->second.users++;
+    pids.try_emplace(process.pid, cgroup);
+}
+
+void CgroupStats::remove_pid(pid_t pid) {
+    auto pid_it = pids.find(pid);
+
+    if (pid_it == pids.end())
+        return;
+
+    auto it = groups.find(pid_it->second);
+    pids.erase(pid_it);
+
+    if (it != groups.end() && --it->second.users <= 0) {
+        SPDLOG_DEBUG("cgroup: no tracked processes left in \"{}\"", it->second.path);
+        groups.erase(it);
+    }
+}
+
+void CgroupStats::poll_group(group& g) {
+    char buf[8192];
+
+    auto read = [&](cgroup_file file) {
+        if (g.fds[file] < 0)
+            return false;
+
+        ssize_t len = pread(g.fds[file], buf, sizeof(buf) - 1, 0);
+
+        if (len <= 0)
+            return false;
+
+        buf[len] = '\0';
+        return true;
+    };
+
+    auto now = std::chrono::steady_clock::now();
+    float seconds = std::chrono::duration<float>(now - g.previous_time).count();
+
+    if (!g.has_previous)
+        seconds = 0.f;
+
+    cgroup_stats_t& s = g.stats;
+    s.valid = false;
+
+    if (read(CPU_STAT)) {
+        uint64_t usage_usec = 0;
+        uint64_t throttled_usec = 0;
+
+        for_each_key_value(buf, [&](std::string_view key, uint64_t value) {
+            if (key == "usage_usec")
+                usage_usec = value;
+            else if (key == "throttled_usec")
+                throttled_usec = value;
+            else if (key == "nr_throttled")
+                s.nr_throttled = value;
+        });
+
+        s.cpu_load = rate(usage_usec, g.previous_usage_usec, seconds) / 10'000.f;
+        s.throttled_ms_per_sec = rate(throttled_usec, g.previous_throttled_usec, seconds) / 1'000.f;
+
+        g.previous_usage_usec = usage_usec;
+        g.previous_throttled_usec = throttled_usec;
+        s.valid = true;
+    }
+
+    if (read(MEMORY_CURRENT)) {
+        s.memory_current = std::strtoull(buf, nullptr, 10);
+        s.valid = true;
+    }
+
+    if (read(MEMORY_STAT)) {
+        uint64_t pgmajfault = 0;
+        uint64_t workingset_refault = 0;
+
+        // workingset_refault is split into _anon and _file since linux 5.9
+        for_each_key_value(buf, [&](std::string_view key, uint64_t value) {
+            if (key == "anon")
+                s.memory_anon = value;
+            else if (key == "file")
+                s.memory_file = value;
+            else if (key == "shmem")
+                s.memory_shmem = value;
+            else if (key == "kernel")
+                s.memory_kernel = value;
+            else if (key == "pgmajfault")
+                pgmajfault = value;
+            else if (key == "workingset_refault" ||
+                     key == "workingset_refault_anon" ||
+                     key == "workingset_refault_file")
+                workingset_refault += value;
+        });
+
+        s.major_faults_per_sec = rate(pgmajfault, g.previous_pgmajfault, seconds);
+        s.workingset_refault_per_sec = rate(workingset_refault, g.previous_workingset_refault, seconds);
+
+        g.previous_pgmajfault = pgmajfault;
+        g.previous_workingset_refault = workingset_refault;
+        s.valid = true;
+    }
+
+    if (read(MEMORY_EVENTS)) {
+        for_each_key_value(buf, [&](std::string_view key, uint64_t value) {
+            if (key == "high")
+                s.memory_high_events = value;
+            else if (key == "max")
+                s.memory_max_events = value;
+            else if (key == "oom")
+                s.oom_events = value;
+            else if (key == "oom_kill")
+                s.oom_kill_events = value;
+        });
+    }
+
+    if (read(IO_STAT)) {
+        uint64_t read_bytes = 0;
+        uint64_t write_bytes = 0;
+
+        // "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=5 dios=6"
+        for (const char* pos = buf; (pos = std::strstr(pos, "bytes=")); pos += 6) {
+            if (pos == buf)
+                continue;
+
+            if (pos[-1] == 'r')
+                read_bytes += std::strtoull(pos + 6, nullptr, 10);
+            else if (pos[-1] == 'w')
+                write_bytes += std::strtoull(pos + 6, nullptr, 10);
+        }
+
+        s.read_mb_per_sec = rate(read_bytes, g.previous_read_bytes, seconds) / (1024.f * 1024.f);
+        s.write_mb_per_sec = rate(write_bytes, g.previous_write_bytes, seconds) / (1024.f * 1024.f);
+
+        g.previous_read_bytes = read_bytes;
+        g.previous_write_bytes = write_bytes;
+    }
+
+    g.has_previous = true;
+    g.previous_time = now;
+}
+
+void CgroupStats::poll() {
+    for (auto& g : groups)
+        poll_group(g.second);
+}
+
+cgroup_stats_t CgroupStats::get_stats(pid_t pid) const {
+    auto pid_it = pids.find(pid);
+
+    if (pid_it == pids.end())
+        return {};
+
+    auto it = groups.find(pid_it->second);
+
+    if (it == groups.end())
+        return {};
+
+    return it->second.stats;
+}
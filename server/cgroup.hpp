@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <sys/types.h>
+
+#include "process.hpp"
+#include "../common/gpu_metrics.hpp"
+
+// cgroup v2 accounting of client sessions. Every cgroup is read once per
+// tick however many tracked processes it has, and every file is one pread
+// on a fd kept open for as long as the cgroup has tracked processes.
+class CgroupStats {
+private:
+    enum cgroup_file {
+        CPU_STAT,
+        MEMORY_CURRENT,
+        MEMORY_STAT,
+        MEMORY_EVENTS,
+        IO_STAT,
+        CGROUP_FILE_COUNT
+    };
+
+    static const char* const file_names[CGROUP_FILE_COUNT];
+
+    struct group {
+        std::string path;
+        int fds[CGROUP_FILE_COUNT] = { -1, -1, -1, -1, -1 };
+        int users = 0;
+
+        bool has_previous = false;
+        std::chrono::time_point<std::chrono::steady_clock> previous_time;
+
+        uint64_t previous_usage_usec = 0;
+        uint64_t previous_throttled_usec = 0;
+        uint64_t previous_pgmajfault = 0;
+        uint64_t previous_workingset_refault = 0;
+        uint64_t previous_read_bytes = 0;
+        uint64_t previous_write_bytes = 0;
+
+        cgroup_stats_t stats;
+
+        group() = default;
+        ~group();
+
+        group(const group&) = delete;
+        group& operator=(const group&) = delete;
+    };
+
+    const std::string cgroup_root = "/sys/fs/cgroup";
+
+    std::map<std::string, group> groups;
+    std::unordered_map<pid_t, std::string> pids;
+
+    void open_group(group& g);
+    void poll_group(group& g);
+
+public:
+    void add_pid(const ProcessHandle& process);
+    void remove_pid(pid_t pid);
+    void poll();
+    cgroup_stats_t get_stats(pid_t pid) const;
+};
@@ -1,26 +1,38 @@
 #include <spdlog/spdlog.h>
-#include <numeric>
-#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "cpu.hpp"
+#include "../../common/helpers.hpp"
 #include "power/rapl.hpp"
 #include "power/zenpower.hpp"
 #include "power/zenergy.hpp"
 
 CPU::CPU() {
-    ifs_stat.open("/proc/stat");
-    ifs_cpuinfo.open("/proc/cpuinfo");
+    stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    cpuinfo_fd = open("/proc/cpuinfo", O_RDONLY | O_CLOEXEC);
 
-    if (!ifs_stat.is_open())
+    if (stat_fd < 0)
         SPDLOG_WARN("failed to open cpu stats file. cpu load will not work.");
 
-    if (!ifs_cpuinfo.is_open())
+    if (cpuinfo_fd < 0)
         SPDLOG_WARN("failed to open cpu info file. cpu frequency will not work.");
 
     power_usage = init_power_usage();
     temperature.find_temperature_sensor();
 }
 
+CPU::~CPU() {
+    if (stat_fd >= 0)
+        close(stat_fd);
+
+    if (cpuinfo_fd >= 0)
+        close(cpuinfo_fd);
+}
+
 std::unique_ptr<CPUPower> CPU::init_power_usage() {
     std::unique_ptr<CPUPower> tmp_usage = std::make_unique<Zenpower>();
 
@@ -36,7 +48,7 @@ std::unique_ptr<CPUPower> CPU::init_power_usage() {
         return tmp_usage;
     }
 
-    tmp_usage = std::make_unique<RAPL>();
+    tmp_usage = std::make_unique<RAPL>(powercap);
 
     if (tmp_usage->is_initialized()) {
         SPDLOG_INFO("Using RAPL for cpu power");
@@ -58,59 +70,62 @@ cpu_info_t CPU::get_info() {
     return info;
 }
 
-std::vector<core_info_t> CPU::get_core_info() {
+const std::vector<core_info_t>& CPU::get_core_info() {
     return cores;
 }
 
-std::vector<std::vector<uint64_t>> CPU::get_cpu_times() {
-    if (!ifs_stat.is_open())
-        return {};
+uint8_t CPU::get_power_domains(cpu_power_domain_t* domains, uint8_t max_domains) {
+    return powercap.get_domains(domains, max_domains);
+}
 
-    ifs_stat.clear();
-    ifs_stat.seekg(0);
+// line is "cpu  user nice system idle ..." or "cpuN user nice system idle ..."
+bool CPU::get_cpu_times(const char* line, uint64_t &idle_time, uint64_t &total_time) {
+    const char* eol = std::strchr(line, '\n');
+    const char* pos = std::strchr(line, ' ');
 
-    std::vector<std::vector<uint64_t>> times;
+    if (!pos || (eol && pos > eol))
+        return false;
 
-    for (std::string line; std::getline(ifs_stat, line);) {
-        if (line.substr(0, 3) != "cpu")
-            continue;
+    size_t count = 0;
+    total_time = 0;
 
-        std::stringstream ss(line);
-        ss.seekg(5);
+    while (!eol || pos < eol) {
+        char* end = nullptr;
+        uint64_t time = std::strtoull(pos, &end, 10);
 
-        std::vector<uint64_t> cpu_times;
+        if (end == pos || (eol && end > eol))
+            break;
 
-        size_t time = 0;
-        while (ss >> time) {
-            cpu_times.push_back(time);
-            time = 0;
-        }
+        if (count == 3)
+            idle_time = time;
 
-        times.push_back(cpu_times);
+        total_time += time;
+        count++;
+        pos = end;
     }
 
-    return times;
-}
-
-bool CPU::get_cpu_times(
-    const std::vector<uint64_t>& cpu_times, uint64_t &idle_time, uint64_t &total_time
-) {
-    if (cpu_times.size() < 4)
-        return false;
-
-    idle_time = cpu_times[3];
-    total_time = std::accumulate(cpu_times.begin(), cpu_times.end(), 0);
-    return true;
+    return count >= 4;
 }
 
 void CPU::poll_load() {
-    std::vector<std::vector<uint64_t>> cpu_times = get_cpu_times();
+    if (stat_fd < 0 || pread_all(stat_fd, stat_buf) <= 0)
+        return;
+
+    const char* line = stat_buf.data();
 
-    for (size_t i = 0; i < cpu_times.size(); i++) {
+    // cpu lines always come first
+    for (size_t i = 0; line && std::strncmp(line, "cpu", 3) == 0; i++) {
         uint64_t idle_time = 0;
         uint64_t total_time = 0;
 
-        if (!get_cpu_times(cpu_times[i], idle_time, total_time))
+        bool valid = get_cpu_times(line, idle_time, total_time);
+
+        line = std::strchr(line, '\n');
+
+        if (line)
+            line++;
+
+        if (!valid)
             continue;
 
         if (i > 0 && cores.size() <= i - 1)
@@ -138,29 +153,28 @@ void CPU::poll_load() {
 }
 
 void CPU::poll_frequency() {
-    if (!ifs_cpuinfo.is_open())
+    if (cpuinfo_fd < 0 || pread_all(cpuinfo_fd, cpuinfo_buf) <= 0)
         return;
 
-    ifs_cpuinfo.clear();
-    ifs_cpuinfo.seekg(0);
-
     size_t cur_core = 0;
 
-    for (std::string line; std::getline(ifs_cpuinfo, line);) {
-        if (line.empty() || line.find(":") + 1 == line.length())
-            continue;
+    for (const char* line = cpuinfo_buf.data(); line && *line;) {
+        if (std::strncmp(line, "cpu MHz", 7) == 0) {
+            const char* val = std::strchr(line, ':');
 
-        std::string key = line.substr(0, line.find(":") - 2);
-        std::string val = line.substr(key.length() + 3);
+            if (val) {
+                if (cores.size() < cur_core + 1)
+                    cores.push_back({});
 
-        if (key != "cpu MHz")
-            continue;
+                cores[cur_core].frequency = std::round(std::strtof(val + 1, nullptr));
+                cur_core++;
+            }
+        }
 
-        if (cores.size() < cur_core + 1)
-            cores.push_back({});
+        line = std::strchr(line, '\n');
 
-        cores[cur_core].frequency = std::round(std::stof(val));
-        cur_core++;
+        if (line)
+            line++;
     }
 
     // cpu frequency is equal to maximum frequency of one of its cores
@@ -173,6 +187,8 @@ void CPU::poll_frequency() {
 }
 
 void CPU::poll_power_usage() {
+    powercap.poll();
+
     if (!power_usage)
         return;
 
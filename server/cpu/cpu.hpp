@@ -4,6 +4,7 @@
 #include <fstream>
 #include "../common/gpu_metrics.hpp"
 #include "../hwmon.hpp"
+#include "power/powercap.hpp"
 
 class CPUPower {
 protected:
@@ -49,8 +50,11 @@ public:
 
 class CPU {
 private:
-    std::ifstream ifs_stat;
-    std::ifstream ifs_cpuinfo;
+    int stat_fd = -1;
+    int cpuinfo_fd = -1;
+
+    std::vector<char> stat_buf;
+    std::vector<char> cpuinfo_buf;
 
     std::vector<uint64_t> prev_idle_times;
     std::vector<uint64_t> prev_total_times;
@@ -62,11 +66,9 @@ private:
 
     std::unique_ptr<CPUPower> init_power_usage();
 
-    std::vector<std::vector<uint64_t>> get_cpu_times();
-    bool get_cpu_times(
-        const std::vector<uint64_t>& cpu_times, uint64_t &idle_time, uint64_t &total_time
-    );
+    bool get_cpu_times(const char* line, uint64_t &idle_time, uint64_t &total_time);
 
+    Powercap powercap;
     std::unique_ptr<CPUPower> power_usage;
     CPUTemp temperature;
 
@@ -75,9 +77,14 @@ private:
 
 public:
     CPU();
+    ~CPU();
+
+    CPU(const CPU&) = delete;
+    CPU& operator=(const CPU&) = delete;
 
     void poll();
     virtual void pre_poll_overrides() {}
     cpu_info_t get_info();
-    std::vector<core_info_t> get_core_info();
+    const std::vector<core_info_t>& get_core_info();
+    uint8_t get_power_domains(cpu_power_domain_t* domains, uint8_t max_domains);
 };
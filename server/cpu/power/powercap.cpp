@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "powercap.hpp"
+#include "../../../common/helpers.hpp"
+#include "../../../common/log_errno.hpp"
+
+namespace fs = std::filesystem;
+
+Powercap::Powercap() {
+    find_zones();
+}
+
+Powercap::~Powercap() {
+    for (zone& z : zones)
+        if (z.fd >= 0)
+            close(z.fd);
+}
+
+void Powercap::find_zones() {
+    if (!fs::exists(powercap_path)) {
+        SPDLOG_DEBUG("powercap: \"{}\" doesn't exist", powercap_path);
+        return;
+    }
+
+    std::vector<std::string> entries;
+
+    for (const auto& entry : fs::directory_iterator(powercap_path)) {
+        std::string filename = entry.path().filename().string();
+
+        // intel-rapl-mmio:* zones mirror the MSR package zones,
+        // reading them too would count package energy twice.
+        if (filename.rfind("intel-rapl:", 0) != 0)
+            continue;
+
+        entries.push_back(filename);
+    }
+
+    // intel-rapl:0 must come before intel-rapl:0:0 so subzones
+    // can be named after their parent zone.
+    std::sort(entries.begin(), entries.end());
+
+    for (const std::string& entry : entries) {
+        zone z = {};
+        z.path = powercap_path + "/" + entry;
+
+        std::string name = read_line(z.path + "/name");
+
+        if (name.empty())
+            continue;
+
+        // intel-rapl:0:1 is a subzone of intel-rapl:0
+        size_t parent_end = entry.rfind(':');
+        bool is_subzone = parent_end != entry.find(':');
+
+        if (is_subzone) {
+            std::string parent_path = powercap_path + "/" + entry.substr(0, parent_end);
+            auto parent = std::find_if(zones.begin(), zones.end(), [&](const zone& p) {
+                return p.path == parent_path;
+            });
+
+            if (parent != zones.end())
+                name = parent->name + "/" + name;
+        }
+
+        z.name = name;
+        z.is_package = !is_subzone && name.rfind("package-", 0) == 0;
+        z.max_energy_range_uj = try_stoull(read_line(z.path + "/max_energy_range_uj"));
+
+        std::string energy_path = z.path + "/energy_uj";
+        z.fd = open(energy_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (z.fd < 0) {
+            LOG_UNIX_ERRNO_DEBUG("powercap: failed to open \"{}\".", energy_path);
+            continue;
+        }
+
+        SPDLOG_DEBUG(
+            "powercap: found zone \"{}\" at {} (max_energy_range_uj = {})",
+            z.name, z.path, z.max_energy_range_uj
+        );
+
+        zones.push_back(std::move(z));
+    }
+}
+
+void Powercap::poll_zone(zone& z) {
+    uint64_t energy_uj = 0;
+
+    if (!pread_uint64(z.fd, energy_uj))
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (!z.has_previous) {
+        z.has_previous = true;
+        z.previous_energy_uj = energy_uj;
+        z.previous_time = now;
+        return;
+    }
+
+    uint64_t delta_uj = 0;
+
+    if (energy_uj >= z.previous_energy_uj)
+        delta_uj = energy_uj - z.previous_energy_uj;
+    else if (z.max_energy_range_uj > z.previous_energy_uj)
+        // counter wrapped around max_energy_range_uj
+        delta_uj = z.max_energy_range_uj - z.previous_energy_uj + energy_uj;
+
+    auto delta_time = std::chrono::duration_cast<std::chrono::nanoseconds>(now - z.previous_time);
+
+    z.total_energy_uj += delta_uj;
+
+    if (delta_time.count() > 0)
+        z.power = delta_uj * 1'000.f / delta_time.count();
+
+    z.previous_energy_uj = energy_uj;
+    z.previous_time = now;
+}
+
+void Powercap::poll() {
+    for (zone& z : zones)
+        poll_zone(z);
+}
+
+bool Powercap::has_package_zones() const {
+    return std::any_of(zones.begin(), zones.end(), [](const zone& z) {
+        return z.is_package;
+    });
+}
+
+float Powercap::get_package_power() const {
+    float power = 0.f;
+
+    for (const zone& z : zones)
+        if (z.is_package)
+            power += z.power;
+
+    return power;
+}
+
+uint8_t Powercap::get_domains(cpu_power_domain_t* domains, uint8_t max_domains) const {
+    uint8_t count = 0;
+
+    for (const zone& z : zones) {
+        if (count >= max_domains)
+            break;
+
+        cpu_power_domain_t& d = domains[count++];
+
+        std::strncpy(d.name, z.name.c_str(), sizeof(d.name) - 1);
+        d.name[sizeof(d.name) - 1] = '\0';
+        d.power = z.power;
+        d.energy_uj = z.total_energy_uj;
+    }
+
+    return count;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "../../../common/gpu_metrics.hpp"
+
+// All zones and subzones of /sys/class/powercap/intel-rapl:*
+// (package-N, package-N/core, package-N/uncore, package-N/dram, psys).
+// energy_uj wraps at max_energy_range_uj, so each zone accumulates
+// its own 64-bit counter and keeps its own read timestamp.
+class Powercap {
+private:
+    struct zone {
+        std::string name;
+        std::string path;
+        bool is_package = false;
+
+        int fd = -1;
+        uint64_t max_energy_range_uj = 0;
+
+        bool has_previous = false;
+        uint64_t previous_energy_uj = 0;
+        std::chrono::time_point<std::chrono::steady_clock> previous_time;
+
+        uint64_t total_energy_uj = 0;
+        float power = 0.f;
+    };
+
+    const std::string powercap_path = "/sys/class/powercap";
+    std::vector<zone> zones;
+
+    void find_zones();
+    void poll_zone(zone& z);
+
+public:
+    Powercap();
+    ~Powercap();
+
+    Powercap(const Powercap&) = delete;
+    Powercap& operator=(const Powercap&) = delete;
+
+    void poll();
+    bool has_package_zones() const;
+    float get_package_power() const;
+
+    // fills at most max_domains entries, returns number of filled entries
+    uint8_t get_domains(cpu_power_domain_t* domains, uint8_t max_domains) const;
+};
@@ -1,18 +1,13 @@
 #pragma once
 
-#include "../../hwmon.hpp"
 #include "../cpu.hpp"
+#include "powercap.hpp"
 
-class RAPL : public CPUPower, private Hwmon {
+class RAPL : public CPUPower {
 private:
-    const std::string rapl_path = "/sys/class/powercap/intel-rapl:0";
-    const std::vector<hwmon_sensor> sensors = { { "energy", "energy_uj" } };
-    uint64_t previous_usage = 0;
-
-protected:
-    void pre_poll_overrides() override;
+    const Powercap& powercap;
 
 public:
-    RAPL();
+    explicit RAPL(const Powercap& powercap);
     float get_power_usage() override;
 };
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "process_cpu.hpp"
+
+// fields of /proc/<pid>/stat, see proc(5)
+enum stat_field {
+    STAT_UTIME = 14,
+    STAT_STIME = 15,
+    STAT_NUM_THREADS = 20,
+    STAT_PROCESSOR = 39,
+    STAT_FIELD_COUNT
+};
+
+// "run_time_ns run_delay_ns timeslices"
+static bool parse_schedstat(const char* buf, uint64_t& run_delay_ns) {
+    char* end = nullptr;
+
+    std::strtoull(buf, &end, 10);
+
+    if (end == buf)
+        return false;
+
+    run_delay_ns = std::strtoull(end, nullptr, 10);
+    return true;
+}
+
+static bool parse_ctx_switches(const char* buf, uint64_t& voluntary, uint64_t& involuntary) {
+    const char* v = std::strstr(buf, "\nvoluntary_ctxt_switches:");
+    const char* nv = std::strstr(buf, "\nnonvoluntary_ctxt_switches:");
+
+    if (!v || !nv)
+        return false;
+
+    voluntary = std::strtoull(v + 25, nullptr, 10);
+    involuntary = std::strtoull(nv + 28, nullptr, 10);
+
+    return true;
+}
+
+static bool read_fd(int fd, char* buf, size_t size) {
+    if (fd < 0)
+        return false;
+
+    ssize_t len = pread(fd, buf, size - 1, 0);
+
+    if (len <= 0)
+        return false;
+
+    buf[len] = '\0';
+    return true;
+}
+
+static uint64_t delta(uint64_t current, uint64_t previous) {
+    return current >= previous ? current - previous : 0;
+}
+
+ProcessCPU::thread::~thread() {
+    for (int fd : { stat_fd, schedstat_fd, status_fd })
+        if (fd >= 0)
+            close(fd);
+}
+
+ProcessCPU::ProcessCPU() {
+    long ret = sysconf(_SC_CLK_TCK);
+
+    if (ret > 0)
+        ticks_per_sec = ret;
+}
+
+void ProcessCPU::add_pid(const std::shared_ptr<ProcessHandle>& process) {
+    if (pids.find(process->pid) != pids.end())
+        return;
+
+    SPDLOG_DEBUG("adding pid {} to process cpu", process->pid);
+    pids[process->pid].process = process;
+}
+
+void ProcessCPU::remove_pid(pid_t pid) {
+    pids.erase(pid);
+}
+
+void ProcessCPU::poll_process(_process_cpu& p) {
+    char buf[4096];
+
+    if (p.process->read(ProcessHandle::STAT, buf, sizeof(buf)) <= 0)
+        return;
+
+    uint64_t fields[STAT_FIELD_COUNT] = {};
+
+    if (!parse_stat(buf, fields, STAT_FIELD_COUNT))
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t ticks = fields[STAT_UTIME] + fields[STAT_STIME];
+    float seconds = std::chrono::duration<float>(now - p.last_update).count();
+
+    if (p.has_previous && seconds > 0.f && ticks >= p.previous_ticks)
+        p.info.load = (ticks - p.previous_ticks) * 100.f / ticks_per_sec / seconds;
+
+    p.has_previous = true;
+    p.previous_ticks = ticks;
+    p.last_update = now;
+
+    uint32_t subscriptions = p.process->subscriptions;
+    bool with_sched = subscriptions & SUBSCRIBE_SCHED;
+
+    if (!(subscriptions & (SUBSCRIBE_THREADS | SUBSCRIBE_SCHED))) {
+        if (!p.threads.empty()) {
+            p.threads.clear();
+            p.num_threads = 0;
+        }
+
+        p.info.num_of_threads = 0;
+        p.info.num_of_delayed_threads = 0;
+    } else {
+        if (fields[STAT_NUM_THREADS] != p.num_threads ||
+            now - p.last_task_refresh > task_refresh_interval) {
+            p.num_threads = fields[STAT_NUM_THREADS];
+            p.last_task_refresh = now;
+            refresh_tasks(p);
+        }
+
+        poll_threads(p, seconds, with_sched);
+    }
+
+    // members of process groups only contribute load to the group
+    if (with_sched || !p.process->is_client)
+        return;
+
+    // /proc/<pid>/schedstat and status aren't summed over the thread
+    // group, so without per-thread tracking this is main thread only
+    sched_counters sched;
+
+    sched.valid =
+        p.process->read(ProcessHandle::SCHEDSTAT, buf, sizeof(buf)) > 0 &&
+        parse_schedstat(buf, sched.run_delay_ns) &&
+        p.process->read(ProcessHandle::STATUS, buf, sizeof(buf)) > 0 &&
+        parse_ctx_switches(buf, sched.voluntary_switches, sched.involuntary_switches);
+
+    if (sched.valid && p.previous_sched.valid && seconds > 0.f) {
+        const sched_counters& prev = p.previous_sched;
+
+        p.info.run_delay = delta(sched.run_delay_ns, prev.run_delay_ns) / seconds / 1'000'000.f;
+        p.info.voluntary_switches_per_sec = delta(sched.voluntary_switches, prev.voluntary_switches) / seconds;
+        p.info.involuntary_switches_per_sec = delta(sched.involuntary_switches, prev.involuntary_switches) / seconds;
+    }
+
+    p.previous_sched = sched;
+}
+
+void ProcessCPU::refresh_tasks(_process_cpu& p) {
+    for (auto& t : p.threads)
+        t.second.seen = false;
+
+    p.process->list_tasks(tasks);
+
+    for (pid_t tid : tasks) {
+        auto it = p.threads.find(tid);
+
+        if (it != p.threads.end()) {
+            it->second.seen = true;
+            continue;
+        }
+
+        int fd = p.process->open_task_file(tid, "stat");
+
+        if (fd < 0)
+            continue;
+
+        thread& t = p.threads[tid];
+        t.stat_fd = fd;
+        t.info.tid = tid;
+        t.seen = true;
+    }
+
+    for (auto it = p.threads.begin(); it != p.threads.end();) {
+        if (!it->second.seen)
+            it = p.threads.erase(it);
+        else
+            it++;
+    }
+
+    SPDLOG_TRACE("pid {}: tracking {} threads", p.process->pid, p.threads.size());
+}
+
+bool ProcessCPU::poll_thread(thread& t, float seconds, bool with_sched, sched_counters& total) {
+    char buf[4096];
+    uint64_t fields[STAT_FIELD_COUNT] = {};
+
+    // thread exited
+    if (!read_fd(t.stat_fd, buf, sizeof(buf)))
+        return false;
+
+    if (!parse_stat(buf, fields, STAT_FIELD_COUNT, t.info.name, sizeof(t.info.name)))
+        return true;
+
+    uint64_t ticks = fields[STAT_UTIME] + fields[STAT_STIME];
+
+    if (t.has_previous && seconds > 0.f && ticks >= t.previous_ticks)
+        t.info.load = (ticks - t.previous_ticks) * 100.f / ticks_per_sec / seconds;
+
+    t.has_previous = true;
+    t.previous_ticks = ticks;
+    t.info.cpu = fields[STAT_PROCESSOR];
+
+    if (!with_sched)
+        return true;
+
+    sched_counters sched;
+
+    sched.valid =
+        read_fd(t.schedstat_fd, buf, sizeof(buf)) &&
+        parse_schedstat(buf, sched.run_delay_ns) &&
+        read_fd(t.status_fd, buf, sizeof(buf)) &&
+        parse_ctx_switches(buf, sched.voluntary_switches, sched.involuntary_switches);
+
+    if (sched.valid && t.previous_sched.valid && seconds > 0.f) {
+        const sched_counters& prev = t.previous_sched;
+
+        uint64_t run_delay_ns = delta(sched.run_delay_ns, prev.run_delay_ns);
+        uint64_t voluntary = delta(sched.voluntary_switches, prev.voluntary_switches);
+        uint64_t involuntary = delta(sched.involuntary_switches, prev.involuntary_switches);
+
+        t.info.run_delay = run_delay_ns / seconds / 1'000'000.f;
+        t.info.voluntary_switches_per_sec = voluntary / seconds;
+        t.info.involuntary_switches_per_sec = involuntary / seconds;
+
+        total.run_delay_ns += run_delay_ns;
+        total.voluntary_switches += voluntary;
+        total.involuntary_switches += involuntary;
+    }
+
+    t.previous_sched = sched;
+    return true;
+}
+
+void ProcessCPU::poll_threads(_process_cpu& p, float seconds, bool with_sched) {
+    // deltas of all threads since previous tick
+    sched_counters total;
+
+    sorted_threads.clear();
+
+    for (auto it = p.threads.begin(); it != p.threads.end();) {
+        thread& t = it->second;
+
+        // schedstat requires CONFIG_SCHED_INFO
+        if (with_sched && !t.sched_files_opened) {
+            if (t.schedstat_fd < 0)
+                t.schedstat_fd = p.process->open_task_file(it->first, "schedstat");
+
+            if (t.status_fd < 0)
+                t.status_fd = p.process->open_task_file(it->first, "status");
+
+            t.sched_files_opened = true;
+        }
+
+        if (!poll_thread(t, seconds, with_sched, total)) {
+            it = p.threads.erase(it);
+            continue;
+        }
+
+        sorted_threads.push_back(&t);
+        it++;
+    }
+
+    fill_top_threads(
+        p.info.threads, p.info.num_of_threads,
+        sizeof(p.info.threads) / sizeof(p.info.threads[0]),
+        &thread_info_t::load
+    );
+
+    if (!with_sched) {
+        p.info.num_of_delayed_threads = 0;
+        return;
+    }
+
+    fill_top_threads(
+        p.info.delayed_threads, p.info.num_of_delayed_threads,
+        sizeof(p.info.delayed_threads) / sizeof(p.info.delayed_threads[0]),
+        &thread_info_t::run_delay
+    );
+
+    if (seconds > 0.f) {
+        p.info.run_delay = total.run_delay_ns / seconds / 1'000'000.f;
+        p.info.voluntary_switches_per_sec = total.voluntary_switches / seconds;
+        p.info.involuntary_switches_per_sec = total.involuntary_switches / seconds;
+    }
+}
+
+void ProcessCPU::fill_top_threads(
+    thread_info_t* out, uint8_t& count, size_t max,
+    float thread_info_t::* key
+) {
+    size_t n = std::min(sorted_threads.size(), max);
+
+    std::partial_sort(
+        sorted_threads.begin(), sorted_threads.begin() + n, sorted_threads.end(),
+        [key](const thread* a, const thread* b) {
+            return a->info.*key > b->info.*key;
+        }
+    );
+
+    for (size_t i = 0; i < n; i++)
+        out[i] = sorted_threads[i]->info;
+
+    count = n;
+}
+
+void ProcessCPU::poll() {
+    for (auto& p : pids)
+        poll_process(p.second);
+}
+
+process_cpu_t ProcessCPU::get_stats(pid_t pid) const {
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return {};
+
+    return it->second.info;
+}
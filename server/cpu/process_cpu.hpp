@@ -0,0 +1,94 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "../process.hpp"
+#include "../../common/gpu_metrics.hpp"
+
+// CPU usage of clients from utime + stime of /proc/<pid>/stat, and
+// scheduler latency (run queue delay from schedstat, context switches
+// from status).
+// For clients subscribed to "threads" or "sched" every thread is tracked
+// too. task/<tid>/* fds are kept open between ticks and task/ is only
+// listed again when the number of threads changes (or every
+// task_refresh_interval to catch threads replaced one for one),
+// so a game with hundreds of threads costs a few preads per thread.
+class ProcessCPU {
+private:
+    // cumulative counters from schedstat and status
+    struct sched_counters {
+        bool valid = false;
+        uint64_t run_delay_ns = 0;
+        uint64_t voluntary_switches = 0;
+        uint64_t involuntary_switches = 0;
+    };
+
+    struct thread {
+        int stat_fd = -1;
+        int schedstat_fd = -1;
+        int status_fd = -1;
+        // schedstat and status are opened once, on first tick with
+        // "sched", failed opens aren't retried
+        bool sched_files_opened = false;
+
+        bool has_previous = false;
+        uint64_t previous_ticks = 0;
+        sched_counters previous_sched;
+
+        bool seen = false;
+
+        thread_info_t info;
+
+        thread() = default;
+        ~thread();
+
+        thread(const thread&) = delete;
+        thread& operator=(const thread&) = delete;
+    };
+
+    struct _process_cpu {
+        std::shared_ptr<ProcessHandle> process;
+
+        bool has_previous = false;
+        uint64_t previous_ticks = 0;
+        sched_counters previous_sched;
+        std::chrono::time_point<std::chrono::steady_clock> last_update;
+
+        uint64_t num_threads = 0;
+        std::map<pid_t, thread> threads;
+        std::chrono::time_point<std::chrono::steady_clock> last_task_refresh;
+
+        process_cpu_t info;
+    };
+
+    const std::chrono::seconds task_refresh_interval = std::chrono::seconds(5);
+
+    long ticks_per_sec = 100;
+    std::map<pid_t, _process_cpu> pids;
+
+    // reused for sorting threads and listing tasks
+    std::vector<const thread*> sorted_threads;
+    std::vector<int> tasks;
+
+    void poll_process(_process_cpu& p);
+    void refresh_tasks(_process_cpu& p);
+    void poll_threads(_process_cpu& p, float seconds, bool with_sched);
+    bool poll_thread(thread& t, float seconds, bool with_sched, sched_counters& total);
+    void fill_top_threads(
+        thread_info_t* out, uint8_t& count, size_t max,
+        float thread_info_t::* key
+    );
+
+public:
+    ProcessCPU();
+
+    void add_pid(const std::shared_ptr<ProcessHandle>& process);
+    void remove_pid(pid_t pid);
+    void poll();
+    process_cpu_t get_stats(pid_t pid) const;
+};
@@ -1,208 +1,911 @@
-#include <filesystem>
+#include <algorithm>
 #include <vector>
-#include <fstream>
 #include <set>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <spdlog/spdlog.h>
 #include "fdinfo.hpp"
+#include "../common/log_errno.hpp"
 
 namespace fs = std::filesystem;
-using namespace std::chrono_literals;
 
-FDInfoBase::FDInfoBase(const std::string& drm_node, const pid_t pid) : drm_node(drm_node), pid(pid) {
-    init();
+DRMClients drm_clients;
+
+// major number of /dev/dri/* devices
+static const unsigned int drm_major = 226;
+
+// Calls func(key, value) for every "key:\tvalue" line of buf
+template <typename Func>
+static void for_each_fdinfo_line(const char* buf, size_t len, Func func) {
+    std::string_view data(buf, len);
+
+    while (!data.empty()) {
+        size_t eol = data.find('\n');
+        std::string_view line = data.substr(0, eol);
+        data = eol == std::string_view::npos ? std::string_view() : data.substr(eol + 1);
+
+        size_t colon = line.find(':');
+
+        if (colon == std::string_view::npos)
+            continue;
+
+        std::string_view key = line.substr(0, colon);
+        std::string_view val = line.substr(colon + 1);
+
+        while (!val.empty() && (val.front() == ' ' || val.front() == '\t'))
+            val.remove_prefix(1);
+
+        func(key, val);
+    }
+}
+
+// "1234", "1234 ns", "1234 KiB", "1234 Hz" etc., converted to bytes, ns or Hz.
+// Strings like drm-driver or drm-pdev are not numeric.
+static bool parse_value(std::string_view val, uint64_t& out) {
+    static const struct {
+        std::string_view unit;
+        uint64_t multiplier;
+    } units[] = {
+        { ""   , 1                  },
+        { "ns" , 1                  },
+        { "KiB", 1024               },
+        { "MiB", 1024 * 1024        },
+        { "GiB", 1024 * 1024 * 1024 },
+        { "Hz" , 1                  },
+        { "KHz", 1'000              },
+        { "MHz", 1'000'000          },
+    };
+
+    uint64_t number = 0;
+    size_t i = 0;
+
+    for (; i < val.size() && val[i] >= '0' && val[i] <= '9'; i++)
+        number = number * 10 + (val[i] - '0');
+
+    if (i == 0)
+        return false;
+
+    std::string_view unit = val.substr(i);
+
+    while (!unit.empty() && unit.front() == ' ')
+        unit.remove_prefix(1);
+
+    for (const auto& u : units) {
+        if (unit != u.unit)
+            continue;
+
+        out = number * u.multiplier;
+        return true;
+    }
+
+    return false;
 }
 
-void FDInfoBase::init()
-{
-    std::vector<std::string> fds = find_fds();
+// /sys/devices/... path of drm node's device, empty if there is none
+static std::string get_device_path(const std::string& drm_node) {
+    std::error_code ec;
+    fs::path path = fs::canonical("/sys/class/drm/" + drm_node + "/device", ec);
 
-    fds_streams.clear();
-    fds_data.clear();
+    if (ec)
+        return "";
 
-    open_fds(fds);
+    return path.string();
+}
 
-    last_init = std::chrono::steady_clock::now();
+DRMClients::process::~process() {
+    close_fds();
 }
 
-void FDInfoBase::poll() {
-    auto now = std::chrono::steady_clock::now();
-    auto diff = std::chrono::duration_cast<std::chrono::seconds>(now - last_init);
+void DRMClients::process::close_fds() {
+    for (const client_fd& c : fds)
+        close(c.fdinfo_fd);
 
-    // some games open handles to gpus later in the game,
-    // so we need to constantly re-check for new fds
-    if (diff >= 10s)
-        init();
+    fds.clear();
+}
 
-    for (size_t i = 0; i < fds_streams.size(); i++) {
-        fds_streams[i].clear();
-        fds_streams[i].seekg(0);
+void DRMClients::process::remove_client(int fd) {
+    for (auto it = fds.begin(); it != fds.end(); it++) {
+        if (it->fd != fd)
+            continue;
 
-        for (std::string line; std::getline(fds_streams[i], line);) {
-            auto key = line.substr(0, line.find(":"));
-            auto val = line.substr(key.length() + 2);
-            // SPDLOG_TRACE("{} = {}", key, val);
-            fds_data[i][key] = val;
-        }
+        close(it->fdinfo_fd);
+        fds.erase(it);
+        return;
     }
 }
 
-std::vector<std::string> FDInfoBase::find_fds() {
-    std::string dir = "/proc/" + std::to_string(pid) + "/fd";
-    fs::path path = dir;
+bool DRMClients::process::has_client(int fd) const {
+    for (const client_fd& c : fds)
+        if (c.fd == fd)
+            return true;
+
+    return false;
+}
 
-    SPDLOG_DEBUG("fd_dir = {}", dir);
+size_t DRMClients::add_device(const std::string& drm_node, const std::string& pci_dev) {
+    device d;
+    d.pci_dev = pci_dev;
+    d.nodes.insert(drm_node);
 
-    if (!fs::exists(path)) {
-        SPDLOG_DEBUG("{} does not exist", path.string());
-        return {};
-    }
+    // some apps open /dev/dri/cardN instead of render node
+    std::string device_path = get_device_path(drm_node);
+    std::error_code ec;
 
-    std::vector<std::string> fds;
+    for (const auto& entry : fs::directory_iterator("/sys/class/drm", ec)) {
+        std::string name = entry.path().filename().string();
 
-    for (const auto& entry : fs::directory_iterator(path)) {
-        if (!entry.is_symlink())
+        // skip connectors like card0-DP-1
+        if (name.substr(0, 4) != "card" || name.find('-') != std::string::npos)
             continue;
 
-        std::filesystem::path link;
+        if (device_path.empty() || get_device_path(name) != device_path)
+            continue;
+
+        SPDLOG_DEBUG("drm clients: {} is also {}", drm_node, name);
+        d.nodes.insert(name);
+    }
+
+    std::unique_lock lock(mutex);
+    devices.push_back(std::move(d));
+
+    return devices.size() - 1;
+}
+
+void DRMClients::add_pid(const std::shared_ptr<ProcessHandle>& process) {
+    std::unique_lock lock(mutex);
+
+    auto it = pids.find(process->pid);
+
+    // already found by system scan
+    if (it != pids.end()) {
+        it->second.background = false;
+        return;
+    }
+
+    SPDLOG_DEBUG("adding pid {} to drm clients", process->pid);
+
+    // fds are looked up on the next poll
+    auto& p = pids[process->pid];
+    p.handle = process;
+    read_comm(p);
+}
+
+void DRMClients::read_comm(process& p) {
+    // read once, so stat of background processes isn't kept open for it
+    int fd = openat(p.handle->get_dir_fd(), "comm", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return;
+
+    ssize_t len = pread(fd, p.comm, sizeof(p.comm) - 1, 0);
+    close(fd);
+
+    p.comm[std::max<ssize_t>(len, 0)] = '\0';
+
+    if (char* eol = std::strchr(p.comm, '\n'))
+        *eol = '\0';
+}
+
+void DRMClients::enable_system_scan(size_t count) {
+    SPDLOG_INFO("looking for top {} GPU consumers among all processes", count);
+    top_count = count;
+}
+
+void DRMClients::set_top_pids(size_t device, const std::vector<pid_t>& top) {
+    std::unique_lock lock(mutex);
+
+    if (top_pids.size() <= device)
+        top_pids.resize(device + 1);
+
+    top_pids[device] = top;
+}
+
+bool DRMClients::is_top(pid_t pid) const {
+    for (const std::vector<pid_t>& top : top_pids)
+        if (std::find(top.begin(), top.end(), pid) != top.end())
+            return true;
+
+    return false;
+}
+
+bool DRMClients::get_comm(pid_t pid, char* buf, size_t size) {
+    std::unique_lock lock(mutex);
+
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return false;
+
+    std::snprintf(buf, size, "%s", it->second.comm);
+    return true;
+}
+
+void DRMClients::remove_pid(pid_t pid) {
+    std::unique_lock lock(mutex);
+
+    SPDLOG_TRACE("deleting pid {}", pid);
+    pids.erase(pid);
+}
+
+ssize_t DRMClients::read_fdinfo(int fd) {
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if (len < 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+fdinfo_key DRMClients::find_key(std::string_view name) {
+    auto it = key_ids.find(name);
+
+    if (it != key_ids.end())
+        return it->second;
 
-        try {
-            link = fs::read_symlink(entry);
-        } catch(const std::filesystem::filesystem_error& ex) {
-            SPDLOG_TRACE("{}", ex.what());
+    fdinfo_key key = key_names.size();
+    key_names.emplace_back(name);
+    key_ids.emplace(name, key);
+    engine_keys.push_back(find_engine_key(name));
+
+    return key;
+}
+
+DRMClients::engine_key DRMClients::find_engine_key(std::string_view name) {
+    // "drm-engine-" is a prefix of "drm-engine-capacity-", so it goes last
+    static const struct {
+        std::string_view prefix;
+        engine_key_type type;
+    } prefixes[] = {
+        { "drm-engine-capacity-", ENGINE_CAPACITY       },
+        { "drm-total-cycles-"   , ENGINE_TOTAL_CYCLES   },
+        { "drm-cycles-"         , ENGINE_CYCLES         },
+        { "drm-engine-"         , ENGINE_TIME           },
+    };
+
+    for (const auto& p : prefixes) {
+        if (name.size() <= p.prefix.size() || name.substr(0, p.prefix.size()) != p.prefix)
             continue;
+
+        std::string_view engine = name.substr(p.prefix.size());
+
+        for (size_t i = 0; i < engine_names.size(); i++)
+            if (engine_names[i] == engine)
+                return { p.type, static_cast<uint16_t>(i) };
+
+        engine_names.emplace_back(engine);
+        return { p.type, static_cast<uint16_t>(engine_names.size() - 1) };
+    }
+
+    return { NOT_ENGINE_KEY, 0 };
+}
+
+std::string DRMClients::get_engine_name(uint16_t engine) {
+    std::unique_lock lock(mutex);
+
+    if (engine >= engine_names.size())
+        return "";
+
+    return engine_names[engine];
+}
+
+fdinfo_key DRMClients::get_key(std::string_view name) {
+    std::unique_lock lock(mutex);
+    return find_key(name);
+}
+
+void DRMClients::parse_fdinfo(size_t len, client_fd& c) {
+    size_t line = 0;
+
+    for (fdinfo_data::value& v : c.data.values)
+        v.valid = false;
+
+    for (fdinfo_engine& e : c.data.engines)
+        e = {};
+
+    for_each_fdinfo_line(buf, len, [&](std::string_view name, std::string_view val) {
+        fdinfo_key key;
+
+        // lines come in the same order on every read, so usually it's
+        // enough to compare with the key which was on this line before
+        if (line < c.line_keys.size() && key_names[c.line_keys[line]] == name) {
+            key = c.line_keys[line];
+        } else {
+            key = find_key(name);
+
+            if (line < c.line_keys.size())
+                c.line_keys[line] = key;
+            else
+                c.line_keys.push_back(key);
+        }
+
+        line++;
+
+        if (key >= c.data.values.size())
+            c.data.values.resize(key_names.size());
+
+        fdinfo_data::value& v = c.data.values[key];
+        v.valid = parse_value(val, v.value);
+
+        const engine_key& e = engine_keys[key];
+
+        if (e.type == NOT_ENGINE_KEY || !v.valid)
+            return;
+
+        if (e.engine >= c.data.engines.size())
+            c.data.engines.resize(engine_names.size());
+
+        fdinfo_engine& engine = c.data.engines[e.engine];
+
+        switch (e.type) {
+            case ENGINE_TIME:
+                engine.time_ns = v.value;
+                engine.valid = true;
+                break;
+
+            case ENGINE_CYCLES:
+                engine.cycles = v.value;
+                engine.valid = true;
+                break;
+
+            case ENGINE_TOTAL_CYCLES:
+                engine.total_cycles = v.value;
+                break;
+
+            case ENGINE_CAPACITY:
+                engine.capacity = v.value;
+                break;
+
+            default:
+                break;
         }
+    });
+}
+
+bool DRMClients::find_device(std::string_view node, std::string_view pdev, size_t& index) const {
+    // drm-pdev works even if /dev/dri of a container is numbered
+    // differently than the host
+    if (!pdev.empty()) {
+        for (size_t i = 0; i < devices.size(); i++) {
+            if (devices[i].pci_dev != pdev)
+                continue;
 
-        // for some reason supertuxkart opens /dev/dri/card and not renderD
-        // inside podman container.
-        // this is only for testing, so remove it later
-        if (link.filename() != drm_node && link.string().substr(0, 13) != "/dev/dri/card")
+            index = i;
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (devices[i].nodes.find(node) == devices[i].nodes.end())
             continue;
 
-        fds.push_back(entry.path().filename());
+        index = i;
+        return true;
     }
 
-    return fds;
+    return false;
 }
 
-void FDInfoBase::open_fds(const std::vector<std::string>& fds) {
-    // set of unique ids, dont open fds which contain
-    // existing ids, because they will contain same data 
-    std::set<std::string> client_ids;
-    size_t total = 0;
+void DRMClients::add_client(process& p, int fd, dev_t rdev) {
+    pid_t pid = p.handle->pid;
 
-    for (const std::string& fd: fds) {
-        fs::path p = "/proc/" + std::to_string(pid) + "/fdinfo/" + fd;
+    // render nodes start from minor 128
+    char node[32];
+    unsigned int node_minor = minor(rdev);
 
-        if (!fs::exists(p))
-            continue;
+    if (node_minor >= 128)
+        std::snprintf(node, sizeof(node), "renderD%u", node_minor);
+    else
+        std::snprintf(node, sizeof(node), "card%u", node_minor);
+
+    int fdinfo_fd = p.handle->open_fdinfo(fd);
+
+    if (fdinfo_fd < 0) {
+        SPDLOG_TRACE("failed to open fdinfo {} of pid {}", fd, pid);
+        return;
+    }
+
+    client_fd c = { fd, fdinfo_fd, 0, {}, {} };
+    ssize_t len = read_fdinfo(fdinfo_fd);
+    std::string_view pdev;
+
+    if (len > 0) {
+        for_each_fdinfo_line(buf, len, [&](std::string_view key, std::string_view val) {
+            if (key == "drm-pdev")
+                pdev = val;
+        });
+
+        if (find_device(node, pdev, c.device))
+            parse_fdinfo(len, c);
+    }
+
+    uint64_t client_id = 0;
+    fdinfo_key client_id_key = find_key("drm-client-id");
+
+    // gpu isn't tracked or fd is not a drm client
+    if (!c.data.get(client_id_key, client_id)) {
+        close(fdinfo_fd);
+        return;
+    }
 
-        std::ifstream file(p);
+    // fds with the same client id refer to the same drm file
+    // and contain same data, so only first one is read
+    for (const client_fd& other : p.fds) {
+        uint64_t other_id = 0;
 
-        if (!file.is_open()) {
-            SPDLOG_TRACE("failed to open \"{}\"", p.string());
+        if (other.device == c.device && other.data.get(client_id_key, other_id) && other_id == client_id) {
+            close(fdinfo_fd);
+            return;
+        }
+    }
+
+    SPDLOG_DEBUG("pid {}: fd {} is drm client {} of {}", pid, fd, client_id, node);
+    p.fds.push_back(std::move(c));
+}
+
+void DRMClients::scan_fds(process& p, bool full) {
+    // drm fds which were skipped as duplicates are retried when a client
+    // was closed, the fd they duplicated could have been the one
+    bool retry_drm = full || p.needs_scan;
+
+    std::vector<int>& fds = fd_list;
+    p.handle->list_fds(fds);
+    std::sort(fds.begin(), fds.end());
+
+    for (auto it = p.known_fds.begin(); it != p.known_fds.end();) {
+        if (std::binary_search(fds.begin(), fds.end(), it->first)) {
+            it++;
             continue;
         }
 
-        for (std::string line; std::getline(file, line);) {
-            std::string key = line.substr(0, line.find(":"));
-            std::string val = line.substr(key.length() + 2);
+        p.remove_client(it->first);
+        it = p.known_fds.erase(it);
+    }
+
+    size_t new_fds = 0;
 
-            if (key != "drm-client-id" || client_ids.find(val) != client_ids.end())
+    for (int fd : fds) {
+        auto it = p.known_fds.find(fd);
+
+        if (it != p.known_fds.end()) {
+            if (retry_drm && it->second.is_drm && !p.has_client(fd)) {
+                struct stat st;
+
+                if (p.handle->stat_fd(fd, st))
+                    add_client(p, fd, st.st_rdev);
+            }
+
+            if (!full)
                 continue;
+        }
 
-            total += 1;
-            client_ids.insert(val);
+        struct stat st;
+
+        if (!p.handle->stat_fd(fd, st))
+            continue;
+
+        if (it != p.known_fds.end()) {
+            if (it->second.dev == st.st_dev && it->second.ino == st.st_ino)
+                continue;
 
-            fds_streams.push_back(std::move(file));
-            fds_data.push_back({});
+            // fd number was reused for another file
+            p.remove_client(fd);
         }
+
+        bool is_drm = S_ISCHR(st.st_mode) && major(st.st_rdev) == drm_major;
+        p.known_fds[fd] = { st.st_dev, st.st_ino, is_drm };
+        new_fds++;
+
+        if (is_drm)
+            add_client(p, fd, st.st_rdev);
     }
 
-    SPDLOG_DEBUG("Received {} ids, opened {} unique ids", fds.size(), total);
+    SPDLOG_TRACE(
+        "pid {}: {} fds, {} new, {} drm clients",
+        p.handle->pid, fds.size(), new_fds, p.fds.size()
+    );
+
+    p.needs_scan = false;
 }
 
-void FDInfoWrapper::add_pid(pid_t pid) {
-    std::unique_lock lock(pids_mutex);
+void DRMClients::poll_process(process& p) {
+    auto now = std::chrono::steady_clock::now();
+    bool full = now - p.last_full_scan >= full_scan_interval;
+
+    // st_size of /proc/<pid>/fd is a cheap way to notice new fds, without
+    // it (before linux 6.2) fd numbers are listed on every poll
+    size_t fd_count = p.handle->get_fd_count();
+
+    if (full || p.needs_scan || !fd_count || fd_count != p.fd_count)
+        scan_fds(p, full);
+
+    if (full)
+        p.last_full_scan = now;
+
+    p.fd_count = fd_count;
+    p.sample_time = now;
+
+    for (size_t i = 0; i < p.fds.size();) {
+        client_fd& c = p.fds[i];
+        ssize_t len = read_fdinfo(c.fdinfo_fd);
 
-    if (pids.find(pid) == pids.end()) {
-        SPDLOG_DEBUG("adding pid {} to fdinfo", pid);
-        pids.try_emplace(pid, FDInfoBase(drm_node, pid));
+        if (len > 0) {
+            parse_fdinfo(len, c);
+            i++;
+            continue;
+        }
+
+        // fd was closed, fdinfo of the same number can't be opened
+        // before the fd list is looked at again
+        SPDLOG_DEBUG("pid {}: drm fd {} was closed", p.handle->pid, c.fd);
+        p.known_fds.erase(c.fd);
+        close(c.fdinfo_fd);
+        p.fds.erase(p.fds.begin() + i);
+        p.needs_scan = true;
     }
 }
 
-void FDInfoWrapper::poll_all() {
-    std::unique_lock lock(pids_mutex);
-    std::set<pid_t> pids_to_delete;
+void DRMClients::poll() {
+    std::unique_lock lock(mutex);
 
-    for (auto& p : pids) {
-        pid_t pid = p.first;
-        FDInfoBase* data = &p.second;
+    auto now = std::chrono::steady_clock::now();
 
-        SPDLOG_TRACE("polling pid {}", pid);
+    if (now - last_poll < poll_interval)
+        return;
 
-        if (!std::filesystem::exists("/proc/" + std::to_string(pid)))
-            pids_to_delete.insert(pid);
-        else
-            data->poll();
+    last_poll = now;
+
+    bool system_scan = top_count && now - last_system_scan >= system_scan_interval;
+
+    if (system_scan) {
+        scan_system();
+        last_system_scan = now;
     }
 
-    for (const auto& p : pids_to_delete) {
-        SPDLOG_TRACE("deleting pid {}", p);
-        pids.erase(p);
+    for (auto it = pids.begin(); it != pids.end();) {
+        process& p = it->second;
+
+        if (p.background && !system_scan && !is_top(it->first)) {
+            it++;
+            continue;
+        }
+
+        poll_process(p);
+
+        // exited or closed all drm fds
+        if (p.background && p.fds.empty()) {
+            SPDLOG_DEBUG("pid {} ({}) is no longer a drm client", it->first, p.comm);
+            it = pids.erase(it);
+            continue;
+        }
+
+        it++;
     }
 }
 
-float FDInfoWrapper::get_memory_used(pid_t pid, const std::string& key) {
-    float total = 0;
+// any fd pointing to a drm node, looked at before a process gets a handle
+bool DRMClients::has_drm_fd(int proc_fd, pid_t pid) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "%d/fd", pid);
 
-    if (pids.find(pid) == pids.end())
-        return 0.f;
+    fd_list.clear();
+
+    if (!list_numeric_entries(proc_fd, path, fd_list))
+        return false;
+
+    for (int fd : fd_list) {
+        struct stat st;
+        std::snprintf(path, sizeof(path), "%d/fd/%d", pid, fd);
+
+        if (fstatat(proc_fd, path, &st, 0) == 0 && S_ISCHR(st.st_mode) && major(st.st_rdev) == drm_major)
+            return true;
+    }
+
+    return false;
+}
+
+void DRMClients::scan_system() {
+    int proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (proc_fd < 0) {
+        LOG_UNIX_ERRNO_ERROR("Failed to open /proc.");
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    pid_t self = getpid();
+    char path[64];
+
+    proc_list.clear();
+    list_numeric_entries(proc_fd, ".", proc_list);
+
+    for (pid_t pid : proc_list) {
+        // server's own drm fds are not a client's
+        if (pid == self || pids.find(pid) != pids.end())
+            continue;
+
+        std::snprintf(path, sizeof(path), "%d/fd", pid);
+
+        // processes of other users can't be looked into
+        if (faccessat(proc_fd, path, R_OK, 0) < 0)
+            continue;
+
+        // st_size is 0 before linux 6.2, such processes are always rescanned
+        struct stat st;
+
+        if (fstatat(proc_fd, path, &st, 0) < 0)
+            continue;
+
+        size_t fd_count = st.st_size;
+        auto idle = idle_pids.find(pid);
+
+        // fd numbers can be reused for a drm node without changing
+        // their count, same as full scans of tracked processes
+        if (idle != idle_pids.end() && fd_count && idle->second.fd_count == fd_count &&
+            now - idle->second.last_scan < full_scan_interval)
+            continue;
+
+        if (!has_drm_fd(proc_fd, pid)) {
+            idle_pids[pid] = { fd_count, now };
+            continue;
+        }
 
-    FDInfoBase& p = pids.at(pid);
+        // only opens /proc/<pid>, other files are opened on first read
+        auto handle = std::make_shared<ProcessHandle>(pid);
 
-    for (const auto& fd : p.fds_data) {
-        if (fd.find(key) == fd.end())
+        if (!handle->is_valid())
             continue;
 
-        std::string used = fd.at(key);
+        process& p = pids[pid];
+        p.handle = handle;
+        p.background = true;
+
+        scan_fds(p, true);
 
-        if (used.empty())
+        // drm fds of gpus which are not tracked
+        if (p.fds.empty()) {
+            idle_pids[pid] = { fd_count, now };
+            pids.erase(pid);
             continue;
+        }
 
-        float val = static_cast<float>(std::stoull(used));
+        read_comm(p);
+        idle_pids.erase(pid);
 
-        if (used.find("KiB") != std::string::npos)
-            val /= 1024.f * 1024.f;
-        else if (used.find("MiB") != std::string::npos)
-            val /= 1024.f;
+        p.fd_count = fd_count;
+        p.last_full_scan = now;
 
-        total += val;
+        SPDLOG_DEBUG("found drm client pid {} ({})", pid, p.comm);
     }
 
-    return total;
+    close(proc_fd);
+
+    // exited processes and ones which can't be looked
+    // into anymore were not refreshed by the scan
+    for (auto it = idle_pids.begin(); it != idle_pids.end();) {
+        if (now - it->second.last_scan >= full_scan_interval)
+            it = idle_pids.erase(it);
+        else
+            it++;
+    }
 }
 
-uint64_t FDInfoWrapper::get_gpu_time(pid_t pid, const std::string& key) {
-    uint64_t total = 0;
+void DRMClients::get_device_data(
+    size_t device, std::map<pid_t, std::vector<fdinfo_data>>& out,
+    std::map<pid_t, chrono_timer>& sample_times
+) {
+    std::unique_lock lock(mutex);
 
-    if (pids.find(pid) == pids.end())
-        return 0;
+    // background processes are only there for devices they use
+    auto is_reported = [&](const process& p) {
+        return !p.background || std::any_of(p.fds.begin(), p.fds.end(), [&](const client_fd& c) {
+            return c.device == device;
+        });
+    };
 
-    FDInfoBase& p = pids.at(pid);
+    for (auto it = out.begin(); it != out.end();) {
+        auto p = pids.find(it->first);
 
-    for (const auto& fd : p.fds_data) {
-        if (fd.find(key) == fd.end())
+        if (p != pids.end() && is_reported(p->second)) {
+            it++;
             continue;
+        }
 
-        std::string time = fd.at(key);
+        sample_times.erase(it->first);
+        it = out.erase(it);
+    }
 
-        if (time.empty())
+    for (const auto& it : pids) {
+        if (!is_reported(it.second))
             continue;
 
-        total += std::stoull(time);
+        sample_times[it.first] = it.second.sample_time;
+
+        std::vector<fdinfo_data>& fds = out[it.first];
+        size_t n = 0;
+
+        // assign in place to reuse strings of previous tick
+        for (const client_fd& c : it.second.fds) {
+            if (c.device != device)
+                continue;
+
+            if (n < fds.size())
+                fds[n] = c.data;
+            else
+                fds.push_back(c.data);
+
+            n++;
+        }
+
+        fds.resize(n);
+    }
+}
+
+void FDInfoWrapper::poll_all() {
+    drm_clients.poll();
+    drm_clients.get_device_data(device, pids, sample_times);
+    update_engine_loads();
+}
+
+void FDInfoWrapper::update_engine_loads() {
+    for (auto it = previous_engines.begin(); it != previous_engines.end();) {
+        if (pids.find(it->first) != pids.end()) {
+            it++;
+            continue;
+        }
+
+        engine_loads.erase(it->first);
+        it = previous_engines.erase(it);
+    }
+
+    for (const auto& p : pids) {
+        const chrono_timer& time = sample_times[p.first];
+        engine_sample& previous_sample = previous_engines[p.first];
+
+        // Not read since previous tick. Another GPU thread could have
+        // polled just before, or pid is a background one which is read
+        // less often. Loads stay as they are until the next sample.
+        if (time == previous_sample.time)
+            continue;
+
+        float elapsed_ns = 0.f;
+
+        if (previous_sample.time != chrono_timer())
+            elapsed_ns = std::chrono::duration<float, std::nano>(time - previous_sample.time).count();
+
+        engine_totals.clear();
+
+        for (const fdinfo_data& fd : p.second) {
+            if (fd.engines.size() > engine_totals.size())
+                engine_totals.resize(fd.engines.size());
+
+            for (size_t i = 0; i < fd.engines.size(); i++) {
+                const fdinfo_engine& e = fd.engines[i];
+                fdinfo_engine& total = engine_totals[i];
+
+                if (!e.valid)
+                    continue;
+
+                // total cycles is gpu timestamp, same for all clients
+                total.time_ns += e.time_ns;
+                total.cycles += e.cycles;
+                total.total_cycles = std::max(total.total_cycles, e.total_cycles);
+                total.capacity = std::max(total.capacity, e.capacity);
+                total.valid = true;
+            }
+        }
+
+        while (engine_names.size() < engine_totals.size())
+            engine_names.push_back(drm_clients.get_engine_name(engine_names.size()));
+
+        std::vector<fdinfo_engine>& previous = previous_sample.engines;
+        std::vector<float>& loads = engine_loads[p.first];
+
+        loads.assign(engine_totals.size(), -1.f);
+
+        for (size_t i = 0; i < engine_totals.size(); i++) {
+            const fdinfo_engine& cur = engine_totals[i];
+
+            if (!cur.valid)
+                continue;
+
+            loads[i] = 0.f;
+
+            // fds were opened or closed, counters can go backwards
+            if (i >= previous.size() || !previous[i].valid ||
+                cur.time_ns < previous[i].time_ns || cur.cycles < previous[i].cycles)
+                continue;
+
+            const fdinfo_engine& prev = previous[i];
+            float load = 0.f;
+
+            // xe reports busy cycles against gpu timestamp instead of time
+            if (cur.total_cycles > prev.total_cycles)
+                load = static_cast<float>(cur.cycles - prev.cycles) / (cur.total_cycles - prev.total_cycles);
+            else if (elapsed_ns > 0.f)
+                load = (cur.time_ns - prev.time_ns) / elapsed_ns;
+
+            // engine classes with several engines, e.g. multiple
+            // video rings, are busy for capacity * time at most
+            load /= std::max<uint64_t>(cur.capacity, 1);
+            loads[i] = std::min(load * 100.f, 100.f);
+        }
+
+        previous = engine_totals;
+        previous_sample.time = time;
+    }
+}
+
+void FDInfoWrapper::get_engine_loads(pid_t pid, gpu_engines_t& out) {
+    const size_t max = sizeof(out.engines) / sizeof(out.engines[0]);
+    out.num_of_engines = 0;
+
+    auto it = engine_loads.find(pid);
+
+    if (it == engine_loads.end())
+        return;
+
+    const std::vector<float>& loads = it->second;
+
+    for (size_t i = 0; i < loads.size() && out.num_of_engines < max; i++) {
+        if (loads[i] < 0.f)
+            continue;
+
+        gpu_engine_t& e = out.engines[out.num_of_engines++];
+        std::snprintf(e.name, sizeof(e.name), "%s", engine_names[i].c_str());
+        e.load = loads[i];
+    }
+}
+
+bool fdinfo_data::get(fdinfo_key key, uint64_t& out) const {
+    if (key >= values.size() || !values[key].valid)
+        return false;
+
+    out = values[key].value;
+    return true;
+}
+
+float FDInfoWrapper::get_memory_used(pid_t pid, fdinfo_key key) {
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return 0.f;
+
+    uint64_t total = 0;
+
+    for (const fdinfo_data& fd : it->second) {
+        uint64_t used = 0;
+
+        if (fd.get(key, used))
+            total += used;
+    }
+
+    return total / 1024.f / 1024.f / 1024.f;
+}
+
+uint64_t FDInfoWrapper::get_gpu_time(pid_t pid, fdinfo_key key) {
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return 0;
+
+    uint64_t total = 0;
+
+    for (const fdinfo_data& fd : it->second) {
+        uint64_t time = 0;
+
+        if (fd.get(key, time))
+            total += time;
     }
 
     return total;
 }
 
-FDInfo::FDInfo(const std::string& drm_node) : fdinfo(FDInfoWrapper(drm_node)) {}
+FDInfo::FDInfo(const std::string& drm_node, const std::string& pci_dev)
+    : fdinfo(drm_node, pci_dev) {}
@@ -3,45 +3,243 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <chrono>
+#include <unordered_map>
+
+#include "process.hpp"
+#include "../common/gpu_metrics.hpp"
 
-typedef std::map<std::string, std::string> fdinfo_data;
 typedef std::chrono::time_point<std::chrono::steady_clock> chrono_timer;
 
-class FDInfoBase {
+// id of an fdinfo key, see DRMClients::get_key()
+typedef uint16_t fdinfo_key;
+
+// counters of one engine class, see drm-usage-stats in kernel docs
+struct fdinfo_engine {
+    uint64_t time_ns        = 0;    // drm-engine-<engine>
+    uint64_t cycles         = 0;    // drm-cycles-<engine>
+    uint64_t total_cycles   = 0;    // drm-total-cycles-<engine>
+    uint64_t capacity       = 0;    // drm-engine-capacity-<engine>
+    bool valid              = false;
+};
+
+// Numeric values of one drm fd, indexed by key id. Units are dropped on
+// parsing: memory is in bytes, time in ns and frequency in Hz.
+struct fdinfo_data {
+    struct value {
+        uint64_t value = 0;
+        bool valid = false;
+    };
+
+    std::vector<value> values;
+    // indexed by engine id, see DRMClients::get_engine_name()
+    std::vector<fdinfo_engine> engines;
+
+    // false if fd doesn't have such key
+    bool get(fdinfo_key key, uint64_t& out) const;
+};
+
+// Process-wide scanner of DRM clients, shared by all fdinfo-based GPUs.
+// Fds of every tracked process are listed once and fdinfo of each DRM fd
+// is read once per tick, no matter how many GPUs are there. Every fd is
+// assigned to a GPU by its drm-pdev, or by DRM node it points to when
+// driver doesn't report drm-pdev.
+//
+// Fds are discovered incrementally: fd numbers which were already seen
+// are remembered with dev/ino of their file, and only new numbers are
+// looked at. Fds are relisted when number of open fds changes, when a DRM
+// fd is closed, and every full_scan_interval to catch reused fd numbers.
+//
+// With enable_system_scan() every process of the system which has a DRM
+// client is picked up too (e.g. compositors, browsers, shader compilers),
+// not only tracked ones. Such background processes are looked for every
+// system_scan_interval and their fdinfo is read at the same interval,
+// except for the top GPU consumers reported with set_top_pids(), which
+// are read on every poll. Processes without DRM fds are skipped while
+// their number of fds stays the same, for up to full_scan_interval.
+class DRMClients {
 private:
-    std::vector<std::ifstream> fds_streams;
-    chrono_timer last_init;
+    struct device {
+        std::string pci_dev;
+        // render node and card node of the same device
+        std::set<std::string, std::less<>> nodes;
+    };
+
+    struct client_fd {
+        int fd;
+        int fdinfo_fd;
+        size_t device;
+        fdinfo_data data;
+        // key of every line on previous read
+        std::vector<fdinfo_key> line_keys;
+    };
+
+    struct known_fd {
+        dev_t dev;
+        ino_t ino;
+        bool is_drm;
+    };
+
+    struct process {
+        std::shared_ptr<ProcessHandle> handle;
+        std::vector<client_fd> fds;
+
+        // found by system scan, not tracked
+        bool background = false;
+        char comm[16] = {};
+        chrono_timer sample_time;
+
+        std::map<int, known_fd> known_fds;
+        size_t fd_count = 0;
+        bool needs_scan = true;
+        chrono_timer last_full_scan;
+
+        process() = default;
+        ~process();
+
+        process(const process&) = delete;
+        process& operator=(const process&) = delete;
+
+        void close_fds();
+        void remove_client(int fd);
+        bool has_client(int fd) const;
+    };
+
+    std::mutex mutex;
+    std::vector<device> devices;
 
-    std::vector<std::string> find_fds();
-    void open_fds(const std::vector<std::string>& fds);
+    enum engine_key_type : uint8_t {
+        NOT_ENGINE_KEY,
+        ENGINE_TIME,
+        ENGINE_CYCLES,
+        ENGINE_TOTAL_CYCLES,
+        ENGINE_CAPACITY
+    };
+
+    struct engine_key {
+        engine_key_type type;
+        uint16_t engine;
+    };
+
+    // every key ever seen, ids are never reused
+    std::vector<std::string> key_names;
+    std::map<std::string, fdinfo_key, std::less<>> key_ids;
+    // by key id
+    std::vector<engine_key> engine_keys;
+    std::vector<std::string> engine_names;
+
+    std::map<pid_t, process> pids;
+
+    std::atomic<size_t> top_count = 0;
+    chrono_timer last_system_scan;
+    const std::chrono::seconds system_scan_interval = std::chrono::seconds(10);
+    // processes without drm clients on previous system scans
+    struct idle_process {
+        size_t fd_count;
+        chrono_timer last_scan;
+    };
+
+    std::unordered_map<pid_t, idle_process> idle_pids;
+    // reused for listing /proc
+    std::vector<int> proc_list;
+    // by device
+    std::vector<std::vector<pid_t>> top_pids;
+
+    chrono_timer last_poll;
+    // GPU threads tick once a second, whichever comes first rescans
+    // and the rest reuse its data
+    const std::chrono::milliseconds poll_interval = std::chrono::milliseconds(900);
+    const std::chrono::seconds full_scan_interval = std::chrono::seconds(10);
+
+    char buf[16384];
+    // reused for listing fds
+    std::vector<int> fd_list;
+
+    ssize_t read_fdinfo(int fd);
+    fdinfo_key find_key(std::string_view name);
+    engine_key find_engine_key(std::string_view name);
+    void parse_fdinfo(size_t len, client_fd& c);
+    bool find_device(std::string_view node, std::string_view pdev, size_t& index) const;
+    void add_client(process& p, int fd, dev_t rdev);
+    void scan_fds(process& p, bool full);
+    void poll_process(process& p);
+    void read_comm(process& p);
+    bool has_drm_fd(int proc_fd, pid_t pid);
+    void scan_system();
+    bool is_top(pid_t pid) const;
 
 public:
-    const std::string drm_node;
-    const pid_t pid;
+    // interns key name, backends look their keys up once
+    fdinfo_key get_key(std::string_view name);
 
-    FDInfoBase(const std::string& drm_node, const pid_t pid);
-    std::vector<fdinfo_data> fds_data;
+    // "gfx", "render", "video" etc.
+    std::string get_engine_name(uint16_t engine);
 
-    void init();
+    // returns index of device for get_device_data()
+    size_t add_device(const std::string& drm_node, const std::string& pci_dev);
+
+    void add_pid(const std::shared_ptr<ProcessHandle>& process);
+    void remove_pid(pid_t pid);
+
+    // look for drm clients in all processes, count is number
+    // of top GPU consumers reported for every GPU
+    void enable_system_scan(size_t count);
+    size_t get_top_count() const { return top_count; }
+    void set_top_pids(size_t device, const std::vector<pid_t>& pids);
+
+    // false if pid is not known
+    bool get_comm(pid_t pid, char* buf, size_t size);
+
+    // rescans fdinfo of all pids, unless it was done less than
+    // poll_interval ago
     void poll();
+
+    // fdinfo of all fds of device by pid, and time when it was read
+    void get_device_data(
+        size_t device, std::map<pid_t, std::vector<fdinfo_data>>& out,
+        std::map<pid_t, chrono_timer>& sample_times
+    );
 };
 
+extern DRMClients drm_clients;
+
 struct FDInfoWrapper {
-    std::mutex pids_mutex;
-    std::map<pid_t, FDInfoBase> pids;
-    const std::string drm_node;
+    const size_t device;
+    // owned by GPU thread, refreshed by poll_all()
+    std::map<pid_t, std::vector<fdinfo_data>> pids;
+    std::map<pid_t, chrono_timer> sample_times;
+
+    struct engine_sample {
+        chrono_timer time;
+        std::vector<fdinfo_engine> engines;
+    };
+
+    // engine counters summed over fds of a pid on previous sample and
+    // utilization since then, -1 for engines pid doesn't report
+    std::map<pid_t, engine_sample> previous_engines;
+    std::map<pid_t, std::vector<float>> engine_loads;
+    std::vector<fdinfo_engine> engine_totals;
+    std::vector<std::string> engine_names;
 
-    explicit FDInfoWrapper(const std::string& drm_node) : drm_node(drm_node) {}
+    FDInfoWrapper(const std::string& drm_node, const std::string& pci_dev)
+        : device(drm_clients.add_device(drm_node, pci_dev)) {}
 
-    void add_pid(pid_t pid);
     void poll_all();
-    float get_memory_used(pid_t pid, const std::string& key);
-    uint64_t get_gpu_time(pid_t pid, const std::string& key);
+    void update_engine_loads();
+    void get_engine_loads(pid_t pid, gpu_engines_t& out);
+    // in GiB
+    float get_memory_used(pid_t pid, fdinfo_key key);
+    // in ns
+    uint64_t get_gpu_time(pid_t pid, fdinfo_key key);
 };
 
 struct FDInfo {
     FDInfoWrapper fdinfo;
-    explicit FDInfo(const std::string& drm_node);
+    FDInfo(const std::string& drm_node, const std::string& pci_dev);
 };
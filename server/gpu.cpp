@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
 #include "gpu.hpp"
 #include "intel/i915/i915.hpp"
@@ -8,6 +10,7 @@
 #include "panfrost.hpp"
 #include "msm/dpu.hpp"
 #include "msm/kgsl.hpp"
+#include "fdinfo.hpp"
 #include "../common/helpers.hpp"
 
 GPUS::GPUS() {
@@ -175,83 +178,217 @@ std::string GPUS::get_driver(const std::string& drm_card_path) {
     return driver;
 }
 
-void GPU::check_pids_existence() {
-    std::set<pid_t> pids_to_delete;
+void add_engine_load(gpu_engines_t& engines, const gpu_engine_t& engine) {
+    const size_t max = sizeof(engines.engines) / sizeof(engines.engines[0]);
 
-    for (const auto& p : process_metrics) {
-        pid_t pid = p.first;
+    for (uint8_t i = 0; i < engines.num_of_engines; i++) {
+        gpu_engine_t& e = engines.engines[i];
+
+        if (std::strcmp(e.name, engine.name) != 0)
+            continue;
 
-        if (!fs::exists("/proc/" + std::to_string(pid)))
-            pids_to_delete.insert(pid);
+        e.load = std::min(e.load + engine.load, 100.f);
+        return;
     }
 
-    for (const auto& p : pids_to_delete)
-        process_metrics.erase(p);
+    if (engines.num_of_engines < max)
+        engines.engines[engines.num_of_engines++] = engine;
+}
+
+void GPU::remove_exited_pids() {
+    std::vector<pid_t> pids;
+
+    {
+        std::unique_lock lock(process_metrics_mutex);
+        pids.swap(exited_pids);
+    }
+
+    for (pid_t pid : pids)
+        previous_gpu_times.erase(pid);
 }
 
 void GPU::poll() {
     while (!stop_thread) {
-        SPDLOG_TRACE("poll()");
+        poll_once();
+        std::this_thread::sleep_for(1s);
+    }
+}
+
+void GPU::poll_once() {
+    SPDLOG_TRACE("poll()");
+
+    auto current_time = std::chrono::steady_clock::now();
+    delta_time_ns = current_time - previous_time;
+    previous_time = current_time;
 
-        auto current_time = std::chrono::steady_clock::now();
-        delta_time_ns = current_time - previous_time;
-        previous_time = current_time;
+    pre_poll_overrides();
 
-        pre_poll_overrides();
+    gpu_metrics_system_t cur_sys_metrics = {
+        .load                   = get_load(),
 
-        gpu_metrics_system_t cur_sys_metrics = {
-            .load                   = get_load(),
+        .vram_used              = get_vram_used(),
+        .gtt_used               = get_gtt_used(),
+        .memory_total           = get_memory_total(),
+        .memory_clock           = get_memory_clock(),
+        .memory_temp            = get_memory_temp(),
 
-            .vram_used              = get_vram_used(),
-            .gtt_used               = get_gtt_used(),
-            .memory_total           = get_memory_total(),
-            .memory_clock           = get_memory_clock(),
-            .memory_temp            = get_memory_temp(),
+        .temperature            = get_temperature(),
+        .junction_temperature   = get_junction_temperature(),
 
-            .temperature            = get_temperature(),
-            .junction_temperature   = get_junction_temperature(),
+        .core_clock             = get_core_clock(),
+        .voltage                = get_voltage(),
 
-            .core_clock             = get_core_clock(),
-            .voltage                = get_voltage(),
+        .power_usage            = get_power_usage(),
+        .power_limit            = get_power_limit(),
 
-            .power_usage            = get_power_usage(),
-            .power_limit            = get_power_limit(),
+        .is_apu                 = get_is_apu(),
+        .apu_cpu_power          = get_apu_cpu_power(),
+        .apu_cpu_temp           = get_apu_cpu_temp(),
 
-            .is_apu                 = get_is_apu(),
-            .apu_cpu_power          = get_apu_cpu_power(),
-            .apu_cpu_temp           = get_apu_cpu_temp(),
+        .is_power_throttled     = get_is_power_throttled(),
+        .is_current_throttled   = get_is_current_throttled(),
+        .is_temp_throttled      = get_is_temp_throttled(),
+        .is_other_throttled     = get_is_other_throttled(),
 
-            .is_power_throttled     = get_is_power_throttled(),
-            .is_current_throttled   = get_is_current_throttled(),
-            .is_temp_throttled      = get_is_temp_throttled(),
-            .is_other_throttled     = get_is_other_throttled(),
+        .fan_speed              = get_fan_speed(),
+        .fan_rpm                = get_fan_rpm(),
 
-            .fan_speed              = get_fan_speed(),
-            .fan_rpm                = get_fan_rpm()
-        };
+        .socket_power           = get_socket_power(),
+        .soc_power              = get_soc_power(),
 
-        check_pids_existence();
+        .pcie_link_width        = get_pcie_link_width(),
+        .pcie_link_speed        = get_pcie_link_speed(),
+        .pcie_bandwidth         = get_pcie_bandwidth(),
 
-        std::map<pid_t, gpu_metrics_process_t> cur_proc_metrics = process_metrics;
+        .requested_clock        = get_requested_clock(),
+        .idle_residency         = get_idle_residency()
+    };
 
+    cur_sys_metrics.num_of_apu_cores = get_apu_cores(
+        cur_sys_metrics.apu_cores, sizeof(cur_sys_metrics.apu_cores) / sizeof(cur_sys_metrics.apu_cores[0])
+    );
+
+    get_samples(cur_sys_metrics.samples);
+
+    cur_sys_metrics.num_of_events = get_events(
+        cur_sys_metrics.events, sizeof(cur_sys_metrics.events) / sizeof(cur_sys_metrics.events[0])
+    );
+
+    remove_exited_pids();
+
+    {
+        std::unique_lock lock(process_metrics_mutex);
+        cur_proc_metrics = process_metrics;
+    }
+
+    for (auto& p : cur_proc_metrics) {
+        pid_t pid = p.first;
+        gpu_metrics_process_t* m = &p.second;
+
+        m->load = get_process_load(pid);
+        m->vram_used = get_process_vram_used(pid);
+        m->gtt_used = get_process_gtt_used(pid);
+        get_process_engines(pid, m->engines);
+    }
+
+    for (const auto& p : cur_proc_metrics)
+        for (uint8_t i = 0; i < p.second.engines.num_of_engines; i++)
+            add_engine_load(cur_sys_metrics.engines, p.second.engines.engines[i]);
+
+    if (size_t count = drm_clients.get_top_count())
+        if (FDInfo* ptr = dynamic_cast<FDInfo*>(this))
+            update_top_clients(ptr->fdinfo, count, cur_sys_metrics);
+
+    {
+        std::unique_lock sys_lock(system_metrics_mutex);
+        std::unique_lock proc_lock(process_metrics_mutex);
+        system_metrics = cur_sys_metrics;
+
+        // pids could have exited while we were polling them,
+        // so only update those which are still there
         for (auto& p : cur_proc_metrics) {
-            pid_t pid = p.first;
-            gpu_metrics_process_t* m = &p.second;
+            auto it = process_metrics.find(p.first);
 
-            m->load = get_process_load(pid);
-            m->vram_used = get_process_vram_used(pid);
-            m->gtt_used = get_process_gtt_used(pid);
+            if (it != process_metrics.end())
+                it->second = p.second;
         }
+    }
+}
 
-        {
-            std::unique_lock sys_lock(system_metrics_mutex);
-            std::unique_lock proc_lock(process_metrics_mutex);
-            system_metrics = cur_sys_metrics;
-            process_metrics = cur_proc_metrics;
+int GPU::get_gpu_time_load(FDInfoWrapper& fdinfo, pid_t pid, uint64_t gpu_time_now) {
+    auto it = fdinfo.sample_times.find(pid);
+
+    if (it == fdinfo.sample_times.end())
+        return 0;
+
+    gpu_time_sample& previous = previous_gpu_times[pid];
+
+    // fdinfo is shared by all GPU threads, pid may not be read again
+    // since previous tick. Load stays as it is until the next sample.
+    if (it->second == previous.time)
+        return previous.load;
+
+    int load = 0;
+
+    // counter goes backwards when fds get closed
+    if (previous.time != decltype(previous.time)() && gpu_time_now >= previous.gpu_time) {
+        float elapsed_ns = std::chrono::duration<float, std::nano>(it->second - previous.time).count();
+
+        if (elapsed_ns > 0.f)
+            load = std::round(std::min((gpu_time_now - previous.gpu_time) / elapsed_ns * 100.f, 100.f));
+    }
+
+    previous = { it->second, gpu_time_now, load };
+    return load;
+}
+
+void GPU::update_top_clients(FDInfoWrapper& fdinfo, size_t count, gpu_metrics_system_t& m) {
+    clients.clear();
+
+    // fdinfo has every process using this gpu when system scan is enabled
+    for (const auto& p : fdinfo.pids) {
+        gpu_client_t c = {};
+        gpu_engines_t engines;
+
+        c.pid = p.first;
+        c.vram_used = get_process_vram_used(c.pid);
+        c.gtt_used = get_process_gtt_used(c.pid);
+
+        fdinfo.get_engine_loads(c.pid, engines);
+
+        for (uint8_t i = 0; i < engines.num_of_engines; i++)
+            c.load += engines.engines[i].load;
+
+        clients.push_back(c);
+    }
+
+    size_t n = std::min({ count, clients.size(), sizeof(m.top_clients) / sizeof(m.top_clients[0]) });
+
+    std::partial_sort(
+        clients.begin(), clients.begin() + n, clients.end(),
+        [](const gpu_client_t& a, const gpu_client_t& b) {
+            if (a.load != b.load)
+                return a.load > b.load;
+
+            if (a.vram_used != b.vram_used)
+                return a.vram_used > b.vram_used;
+
+            return a.gtt_used > b.gtt_used;
         }
+    );
 
-        std::this_thread::sleep_for(1s);
+    std::vector<pid_t> top;
+
+    for (size_t i = 0; i < n; i++) {
+        m.top_clients[i] = clients[i];
+        drm_clients.get_comm(clients[i].pid, m.top_clients[i].name, sizeof(m.top_clients[i].name));
+        top.push_back(clients[i].pid);
     }
+
+    m.num_of_top_clients = n;
+
+    // keep them fresh, rest is read every system scan
+    drm_clients.set_top_pids(fdinfo.device, top);
 }
 
 GPU::GPU(
@@ -271,6 +408,15 @@ void GPU::add_pid(pid_t pid) {
     process_metrics.try_emplace(pid, gpu_metrics_process_t());
 }
 
+void GPU::remove_pid(pid_t pid) {
+    std::unique_lock lock(process_metrics_mutex);
+    process_metrics.erase(pid);
+
+    // per-pid state of backends is owned by worker thread,
+    // let it clean up on the next poll
+    exited_pids.push_back(pid);
+}
+
 gpu_metrics_system_t GPU::get_system_metrics() {
     SPDLOG_TRACE("GPU get_system_metrics()");
     std::unique_lock lock(system_metrics_mutex);
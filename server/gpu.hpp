@@ -17,6 +17,8 @@
 
 #include "../common/gpu_metrics.hpp"
 
+struct FDInfoWrapper;
+
 using namespace std::chrono_literals;
 namespace fs = std::filesystem;
 
@@ -34,11 +36,14 @@ public:
     GPU(const std::string& drm_node, const std::string& pci_dev,
         uint16_t vendor_id, uint16_t device_id, const std::string& thread_name);
 
-    ~GPU();
+    virtual ~GPU();
 
     void add_pid(pid_t pid);
+    void remove_pid(pid_t pid);
     void print_metrics();
-    void start_thread_worker();
+    virtual void start_thread_worker();
+    // one tick of worker thread
+    void poll_once();
 
     virtual gpu_metrics_system_t get_system_metrics();
     virtual std::map<pid_t, gpu_metrics_process_t> get_process_metrics();
@@ -47,6 +52,16 @@ public:
 protected:
     gpu_metrics_system_t system_metrics = {};
     std::map<pid_t, gpu_metrics_process_t> process_metrics;
+    // worker's copy of process_metrics, kept between polls to reuse its nodes
+    std::map<pid_t, gpu_metrics_process_t> cur_proc_metrics;
+    std::vector<pid_t> exited_pids;
+    struct gpu_time_sample {
+        std::chrono::time_point<std::chrono::steady_clock> time;
+        uint64_t gpu_time = 0;
+        int load = 0;
+    };
+    std::map<pid_t, gpu_time_sample> previous_gpu_times;
+    std::vector<gpu_client_t> clients;
 
     std::mutex system_metrics_mutex, process_metrics_mutex;
 
@@ -58,7 +73,11 @@ protected:
 
     virtual void pre_poll_overrides() {}
     void poll();
-    void check_pids_existence();
+    void remove_exited_pids();
+    void update_top_clients(FDInfoWrapper& fdinfo, size_t count, gpu_metrics_system_t& m);
+    // load of pid in percent from its busy time in ns summed over fds,
+    // against time between the last two fdinfo samples of pid
+    int get_gpu_time_load(FDInfoWrapper& fdinfo, pid_t pid, uint64_t gpu_time_now);
 
     // System-related functions
     virtual int     get_load()                  { return -1; }
@@ -90,12 +109,32 @@ protected:
     virtual int     get_fan_speed()             { return 0; }
     virtual bool    get_fan_rpm()               { return true; }
 
+    virtual float   get_socket_power()          { return 0.f; }
+    virtual float   get_soc_power()             { return 0.f; }
+
+    virtual int     get_pcie_link_width()       { return 0; }
+    virtual float   get_pcie_link_speed()       { return 0.f; }
+    virtual float   get_pcie_bandwidth()        { return 0.f; }
+
+    virtual int     get_requested_clock()       { return 0; }
+    virtual float   get_idle_residency()        { return 0.f; }
+
+    virtual uint8_t get_apu_cores(gpu_apu_core_t* out, uint8_t max) { return 0; }
+    virtual void    get_samples(gpu_samples_t& samples) {}
+
     // Process-related functions
     virtual int     get_process_load(pid_t pid)         { return 0; }
     virtual float   get_process_vram_used(pid_t pid)    { return 0.f; }
     virtual float   get_process_gtt_used(pid_t pid)     { return 0.f; }
+    virtual void    get_process_engines(pid_t pid, gpu_engines_t& engines) {}
+
+    // most recent events, oldest first
+    virtual uint8_t get_events(gpu_event_t* out, uint8_t max) { return 0; }
 };
 
+// adds load to engine with the same name, capped at 100%
+void add_engine_load(gpu_engines_t& engines, const gpu_engine_t& engine);
+
 class GPUS {
 private:
     std::string get_pci_device_address(const std::string& drm_card_path);
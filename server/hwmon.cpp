@@ -1,6 +1,13 @@
+#include <fcntl.h>
+#include <unistd.h>
 #include "hwmon.hpp"
 #include "../common/helpers.hpp"
 
+HwmonBase::sensor::~sensor() {
+    if (fd >= 0)
+        close(fd);
+}
+
 void HwmonBase::add_sensors(const std::vector<hwmon_sensor>& input_sensors)
 {
     for (const auto& s : input_sensors) {
@@ -63,9 +70,9 @@ void HwmonBase::open_sensors() {
 
         SPDLOG_DEBUG("hwmon: {} reading found at {}", key, sensor->path);
 
-        sensor->stream.open(sensor->path);
+        sensor->fd = open(sensor->path.c_str(), O_RDONLY | O_CLOEXEC);
 
-        if (!sensor->stream.good()) {
+        if (sensor->fd < 0) {
             SPDLOG_DEBUG(
                 "hwmon: failed to open {} reading {}",
                 key, sensor->path
@@ -147,21 +154,12 @@ void HwmonBase::setup(const std::vector<hwmon_sensor>& input_sensors, const std:
 void HwmonBase::poll_sensors()
 {
     for (auto& s : sensors) {
-        auto name = s.first;
         auto sensor = &s.second;
 
-        if (!sensor->stream.is_open())
-            continue;
-
-        sensor->stream.seekg(0);
-
-        std::stringstream ss;
-        ss << sensor->stream.rdbuf();
-
-        if (ss.str().empty())
+        if (sensor->fd < 0)
             continue;
 
-        sensor->val = std::stoull(ss.str());
+        pread_uint64(sensor->fd, sensor->val);
     }
 }
 
@@ -173,7 +171,7 @@ bool HwmonBase::is_open(const std::string& generic_name) {
     if (sensors.find(generic_name) == sensors.end())
         return false;
 
-    return sensors[generic_name].stream.is_open();
+    return sensors[generic_name].fd >= 0;
 }
 
 uint64_t HwmonBase::get_sensor_value(const std::string& generic_name) {
@@ -25,10 +25,16 @@ private:
         std::string filename;
         std::string label;
 
-        std::ifstream stream;
+        int fd = -1;
         std::string path;
         unsigned char id = 0;
         uint64_t val = 0;
+
+        sensor() = default;
+        ~sensor();
+
+        sensor(const sensor&) = delete;
+        sensor& operator=(const sensor&) = delete;
     };
 
     std::map<std::string, sensor> sensors;
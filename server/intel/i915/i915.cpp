@@ -4,9 +4,10 @@
 Intel_i915::Intel_i915(
     const std::string& drm_node, const std::string& pci_dev,
     uint16_t vendor_id, uint16_t device_id
-) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-intel-i915"), FDInfo(drm_node) {
+) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-intel-i915"), FDInfo(drm_node, pci_dev) {
     hwmon.setup(sensors, drm_node);
     drm_available = drm.setup("/dev/dri/by-path/pci-" + pci_dev + "-card");
+    pmu_available = pmu.setup(pci_dev);
     find_gt_dir();
 }
 
@@ -15,6 +16,16 @@ void Intel_i915::pre_poll_overrides() {
     fdinfo.poll_all();
     drm.poll();
     throttling = get_throttling_status();
+
+    if (pmu_available)
+        pmu.poll();
+}
+
+int Intel_i915::get_load() {
+    if (!pmu_available || !pmu.has_busy())
+        return -1;
+
+    return std::round(pmu.get_busy());
 }
 
 float Intel_i915::get_vram_used() {
@@ -58,6 +69,10 @@ float Intel_i915::get_power_limit() {
 }
 
 int Intel_i915::get_core_clock() {
+    // average since previous poll, sysfs only has current value
+    if (pmu_available && pmu.has_actual_frequency())
+        return std::round(pmu.get_actual_frequency());
+
     if (!ifs_gpu_clock.is_open())
         return 0;
 
@@ -73,6 +88,20 @@ int Intel_i915::get_core_clock() {
     return std::stoi(clock_str);
 }
 
+int Intel_i915::get_requested_clock() {
+    if (!pmu_available)
+        return 0;
+
+    return std::round(pmu.get_requested_frequency());
+}
+
+float Intel_i915::get_idle_residency() {
+    if (!pmu_available)
+        return 0.f;
+
+    return pmu.get_rc6_residency();
+}
+
 int Intel_i915::get_voltage() {
     return hwmon.get_sensor_value("voltage");
 }
@@ -98,31 +127,21 @@ int Intel_i915::get_fan_speed() {
 }
 
 int Intel_i915::get_process_load(pid_t pid) {
-    uint64_t* previous_gpu_time = &previous_gpu_times[pid];
-    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, "drm-engine-render");
-
-    if (!*previous_gpu_time) {
-        *previous_gpu_time = gpu_time_now;
-        return 0;
-    }
+    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, render_time_key);
 
-    float delta_gpu_time = gpu_time_now - *previous_gpu_time;
-    float result = delta_gpu_time / delta_time_ns.count() * 100;
-
-    if (result > 100.f)
-        result = 100.f;
-
-    *previous_gpu_time = gpu_time_now;
-
-    return std::round(result);
+    return get_gpu_time_load(fdinfo, pid, gpu_time_now);
 }
 
 float Intel_i915::get_process_vram_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-total-local0");
+    return fdinfo.get_memory_used(pid, local_key);
 }
 
 float Intel_i915::get_process_gtt_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-total-system0");
+    return fdinfo.get_memory_used(pid, system_key);
+}
+
+void Intel_i915::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    fdinfo.get_engine_loads(pid, engines);
 }
 
 void Intel_i915::find_gt_dir() {
@@ -6,8 +6,9 @@
 #include "hwmon.hpp"
 #include "fdinfo.hpp"
 #include "i915_drm.hpp"
+#include "i915_pmu.hpp"
 
-class Intel_i915 : public GPU, private Hwmon, public FDInfo, private i915_drm {
+class Intel_i915 : public GPU, private Hwmon, public FDInfo, private i915_drm, private i915_pmu {
 private:
     enum GPU_throttle_status : int {
         POWER   = 0b0001,
@@ -25,7 +26,10 @@ private:
     };
 
     uint64_t previous_power_usage = 0;
-    std::map<pid_t, uint64_t> previous_gpu_times;
+
+    const fdinfo_key render_time_key = drm_clients.get_key("drm-engine-render");
+    const fdinfo_key local_key       = drm_clients.get_key("drm-total-local0");
+    const fdinfo_key system_key      = drm_clients.get_key("drm-total-system0");
 
     void find_gt_dir();
     void load_throttle_reasons(
@@ -52,6 +56,7 @@ private:
     };
     
     bool drm_available = false;
+    bool pmu_available = false;
 
 protected:
     void pre_poll_overrides() override;
@@ -63,7 +68,7 @@ public:
     );
 
     // System-related functions
-    // int     get_load() override;             // Not available
+    int     get_load()                          override;
 
     float   get_vram_used()                     override;
     // float   get_gtt_used()         override; // Investigate
@@ -73,6 +78,8 @@ public:
     // int get_junction_temperature() override; // Not available
 
     int     get_core_clock()                    override;
+    int     get_requested_clock()               override;
+    float   get_idle_residency()                override;
     int     get_voltage()                       override;
 
     float   get_power_usage()                   override;
@@ -92,4 +99,5 @@ public:
     int     get_process_load(pid_t pid)         override;
     float   get_process_vram_used(pid_t pid)    override;
     float   get_process_gtt_used(pid_t pid)     override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
 };
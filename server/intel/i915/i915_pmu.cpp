@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <filesystem>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <spdlog/spdlog.h>
+#include "i915_pmu.hpp"
+#include "../../../common/helpers.hpp"
+#include "../../../common/log_errno.hpp"
+
+namespace fs = std::filesystem;
+
+static const std::string pmu_dir = "/sys/bus/event_source/devices/";
+
+static int perf_event_open(perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// event files look like "config=0x100000"
+static bool read_event_config(const std::string& path, uint64_t& config) {
+    std::string line = read_line(path);
+    const std::string prefix = "config=";
+
+    if (line.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    char* end = nullptr;
+    config = strtoull(line.c_str() + prefix.size(), &end, 0);
+
+    return end != line.c_str() + prefix.size();
+}
+
+i915_pmu_base::~i915_pmu_base() {
+    for (auto& c : counters)
+        if (c.fd >= 0)
+            close(c.fd);
+}
+
+std::string i915_pmu_base::find_pmu(const std::string& pci_dev) const {
+    // discrete GPUs have PMU named after their PCI address,
+    // integrated one is just "i915"
+    std::string name = "i915_" + pci_dev;
+    std::replace(name.begin(), name.end(), ':', '_');
+
+    if (fs::exists(pmu_dir + name))
+        return name;
+
+    if (fs::exists(pmu_dir + "i915"))
+        return "i915";
+
+    return "";
+}
+
+bool i915_pmu_base::add_counter(const std::string& name, uint64_t config, int type, int cpu) {
+    perf_event_attr attr = {};
+
+    attr.type = type;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED;
+
+    int fd = perf_event_open(&attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+
+    if (fd < 0) {
+        LOG_UNIX_ERRNO_DEBUG("i915_pmu: failed to open {}.", name);
+        return false;
+    }
+
+    if (group_fd < 0)
+        group_fd = fd;
+
+    counters.push_back({ name, config, fd });
+    return true;
+}
+
+bool i915_pmu_base::setup(const std::string& pci_dev) {
+    std::string pmu = find_pmu(pci_dev);
+
+    if (pmu.empty()) {
+        SPDLOG_DEBUG("i915_pmu: PMU of {} not found", pci_dev);
+        return false;
+    }
+
+    int type = std::atoi(read_line(pmu_dir + pmu + "/type").c_str());
+    // uncore PMU, counts on any one cpu
+    int cpu = std::atoi(read_line(pmu_dir + pmu + "/cpumask").c_str());
+
+    std::vector<std::pair<std::string, uint64_t>> events;
+
+    for (const auto& entry : fs::directory_iterator(pmu_dir + pmu + "/events")) {
+        std::string name = entry.path().filename().string();
+        uint64_t config = 0;
+
+        // gt0 only, like the rest of Intel_i915
+        if (name != "actual-frequency" && name != "requested-frequency" &&
+            name != "rc6-residency" && !ends_with(name, "-busy"))
+            continue;
+
+        if (read_event_config(entry.path().string(), config))
+            events.push_back({ name, config });
+    }
+
+    // keep order stable, so group leader is always the same
+    std::sort(events.begin(), events.end());
+
+    for (const auto& [name, config] : events) {
+        if (!add_counter(name, config, type, cpu))
+            continue;
+
+        int index = counters.size() - 1;
+
+        if (name == "actual-frequency")
+            actual_freq_index = index;
+        else if (name == "requested-frequency")
+            requested_freq_index = index;
+        else if (name == "rc6-residency")
+            rc6_index = index;
+        else if (name.compare(0, 3, "rcs") == 0 || name.compare(0, 3, "ccs") == 0)
+            busy_indexes.push_back(index);
+    }
+
+    if (counters.empty()) {
+        SPDLOG_WARN("i915_pmu: no counters of {} could be opened, GPU load will not be available", pmu);
+        return false;
+    }
+
+    SPDLOG_DEBUG("i915_pmu: {} counters of {} opened", counters.size(), pmu);
+
+    buf.resize(2 + counters.size());
+
+    return true;
+}
+
+void i915_pmu_base::poll() {
+    if (group_fd < 0)
+        return;
+
+    ssize_t len = read(group_fd, buf.data(), buf.size() * sizeof(uint64_t));
+
+    if (len < static_cast<ssize_t>(buf.size() * sizeof(uint64_t)) || buf[0] != counters.size()) {
+        SPDLOG_TRACE("i915_pmu: short group read");
+        return;
+    }
+
+    uint64_t time = buf[1];
+    const uint64_t* values = &buf[2];
+
+    if (has_previous && time > previous_time) {
+        // counters are ns for busy and rc6, MHz * s for frequencies
+        float delta_ns = time - previous_time;
+        auto delta = [&](int i) -> float { return values[i] - counters[i].previous; };
+
+        busy = 0.f;
+
+        for (size_t i : busy_indexes)
+            busy = std::max(busy, delta(i) / delta_ns * 100.f);
+
+        busy = std::min(busy, 100.f);
+
+        if (actual_freq_index >= 0)
+            actual_freq = delta(actual_freq_index) / (delta_ns / 1e9f);
+
+        if (requested_freq_index >= 0)
+            requested_freq = delta(requested_freq_index) / (delta_ns / 1e9f);
+
+        if (rc6_index >= 0)
+            rc6_residency = std::min(delta(rc6_index) / delta_ns * 100.f, 100.f);
+    }
+
+    for (size_t i = 0; i < counters.size(); i++)
+        counters[i].previous = values[i];
+
+    previous_time = time;
+    has_previous = true;
+}
+
+bool i915_pmu_base::has_busy() const {
+    return !busy_indexes.empty();
+}
+
+bool i915_pmu_base::has_actual_frequency() const {
+    return actual_freq_index >= 0;
+}
+
+float i915_pmu_base::get_busy() const {
+    return busy;
+}
+
+float i915_pmu_base::get_actual_frequency() const {
+    return actual_freq;
+}
+
+float i915_pmu_base::get_requested_frequency() const {
+    return requested_freq;
+}
+
+float i915_pmu_base::get_rc6_residency() const {
+    return rc6_residency;
+}
+
+i915_pmu::i915_pmu() {}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// i915 PMU counters opened with perf_event_open() as one group, so
+// everything is read with a single read() per poll. Needs CAP_PERFMON
+// or kernel.perf_event_paranoid <= 0.
+class i915_pmu_base {
+private:
+    struct counter {
+        std::string name;
+        uint64_t config = 0;
+        int fd = -1;
+        uint64_t previous = 0;
+    };
+
+    std::vector<counter> counters;
+    // group leader is counters[0]
+    int group_fd = -1;
+
+    // value in group read, -1 if PMU doesn't have it
+    int actual_freq_index = -1;
+    int requested_freq_index = -1;
+    int rc6_index = -1;
+    // render and compute engines
+    std::vector<size_t> busy_indexes;
+
+    // nr, time_enabled and a value per counter
+    std::vector<uint64_t> buf;
+    uint64_t previous_time = 0;
+    bool has_previous = false;
+
+    float busy = 0.f;
+    float actual_freq = 0.f;
+    float requested_freq = 0.f;
+    float rc6_residency = 0.f;
+
+    std::string find_pmu(const std::string& pci_dev) const;
+    bool add_counter(const std::string& name, uint64_t config, int type, int cpu);
+
+public:
+    ~i915_pmu_base();
+    bool setup(const std::string& pci_dev);
+    void poll();
+
+    bool has_busy() const;
+    bool has_actual_frequency() const;
+
+    // averages over time since previous poll
+    float get_busy() const;                 // %, busiest render or compute engine
+    float get_actual_frequency() const;     // MHz
+    float get_requested_frequency() const;  // MHz
+    float get_rc6_residency() const;        // %
+};
+
+struct i915_pmu {
+    i915_pmu_base pmu;
+    i915_pmu();
+};
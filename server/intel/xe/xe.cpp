@@ -4,7 +4,7 @@
 Intel_xe::Intel_xe(
     const std::string& drm_node, const std::string& pci_dev,
     uint16_t vendor_id, uint16_t device_id
-) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-intel-xe"), FDInfo(drm_node) {
+) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-intel-xe"), FDInfo(drm_node, pci_dev) {
     hwmon.setup(sensors, drm_node);
     drm_available = drm.setup("/dev/dri/by-path/pci-" + pci_dev + "-card");
     find_gt_dir();
@@ -102,27 +102,30 @@ int Intel_xe::get_fan_speed() {
 }
 
 int Intel_xe::get_process_load(pid_t pid) {
-    if (fdinfo.pids.find(pid) == fdinfo.pids.end())
+    auto sample_time = fdinfo.sample_times.find(pid);
+
+    if (fdinfo.pids.find(pid) == fdinfo.pids.end() || sample_time == fdinfo.sample_times.end())
         return 0.f;
 
-    FDInfoBase& p = fdinfo.pids.at(pid);
+    // not read again since previous tick, cycles haven't moved
+    gpu_time_sample& previous = previous_gpu_times[pid];
+
+    if (sample_time->second == previous.time)
+        return previous.load;
 
     double load = 0;
 
-    for (fdinfo_data& fd : p.fds_data) {
-        std::string client_id = fd["drm-client-id"];
-        std::string cur_cycles_str = fd["drm-cycles-rcs"];
-        std::string cur_total_cycles_str = fd["drm-total-cycles-rcs"];
+    for (const fdinfo_data& fd : fdinfo.pids.at(pid)) {
+        uint64_t client_id = 0;
+        uint64_t cur_cycles = 0;
+        uint64_t cur_total_cycles = 0;
 
         if (
-            client_id.empty() || cur_cycles_str.empty() ||
-            cur_total_cycles_str.empty()
+            !fd.get(client_id_key, client_id) || !fd.get(cycles_key, cur_cycles) ||
+            !fd.get(total_cycles_key, cur_total_cycles)
         )
             continue;
 
-        uint64_t cur_cycles = std::stoull(cur_cycles_str);
-        uint64_t cur_total_cycles = std::stoull(cur_total_cycles_str);
-
         if (previous_cycles.find(client_id) == previous_cycles.end()) {
             previous_cycles[client_id] = { cur_cycles, cur_total_cycles };
             continue;
@@ -146,15 +149,22 @@ int Intel_xe::get_process_load(pid_t pid) {
     if (load > 100.f)
         load = 100.f;
 
-    return std::lround(load);
+    previous.time = sample_time->second;
+    previous.load = std::lround(load);
+
+    return previous.load;
 }
 
 float Intel_xe::get_process_vram_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-resident-vram0");
+    return fdinfo.get_memory_used(pid, vram_key);
 }
 
 float Intel_xe::get_process_gtt_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-resident-gtt");
+    return fdinfo.get_memory_used(pid, gtt_key);
+}
+
+void Intel_xe::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    fdinfo.get_engine_loads(pid, engines);
 }
 
 void Intel_xe::find_gt_dir()
@@ -27,7 +27,14 @@ private:
     };
 
     uint64_t previous_power_usage = 0;
-    std::map<std::string, std::pair<uint64_t, uint64_t>> previous_cycles;
+    // by drm-client-id
+    std::map<uint64_t, std::pair<uint64_t, uint64_t>> previous_cycles;
+
+    const fdinfo_key client_id_key    = drm_clients.get_key("drm-client-id");
+    const fdinfo_key cycles_key       = drm_clients.get_key("drm-cycles-rcs");
+    const fdinfo_key total_cycles_key = drm_clients.get_key("drm-total-cycles-rcs");
+    const fdinfo_key vram_key         = drm_clients.get_key("drm-resident-vram0");
+    const fdinfo_key gtt_key          = drm_clients.get_key("drm-resident-gtt");
 
     void find_gt_dir();
     void load_throttle_reasons(
@@ -95,4 +102,5 @@ public:
     int     get_process_load(pid_t pid)         override;
     float   get_process_vram_used(pid_t pid)    override;
     float   get_process_gtt_used(pid_t pid)     override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
 };
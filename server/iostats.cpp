@@ -1,28 +1,16 @@
-#include <fstream>
-#include <set>
-#include <filesystem>
+#include <cstring>
+#include <cstdlib>
 #include <spdlog/spdlog.h>
 #include "iostats.hpp"
-#include "../common/helpers.hpp"
 
-void IOStats::add_pid(pid_t pid) {
+void IOStats::add_pid(const std::shared_ptr<ProcessHandle>& process) {
+    pid_t pid = process->pid;
+
     if (pids.find(pid) != pids.end())
         return;
 
     SPDLOG_DEBUG("adding pid {} to iostats", pid);
-    auto entry = pids.try_emplace(pid, _io_stats());
-
-    if (!entry.second)
-        return;
-
-    std::string f = "/proc/" + std::to_string(pid) + "/io";
-    std::ifstream& stream = entry.first->second.stream;
-    stream.open(f);
-
-    if (!stream.is_open()) {
-        SPDLOG_DEBUG("failed to open \"{}\"", f);
-        return;
-    }
+    pids[pid].process = process;
 }
 
 void IOStats::poll_pid(pid_t pid) {
@@ -31,16 +19,21 @@ void IOStats::poll_pid(pid_t pid) {
     uint64_t total_read = 0;
     uint64_t total_write = 0;
 
-    stats.stream.clear();
-    stats.stream.seekg(0);
+    char buf[512];
+
+    if (stats.process->read(ProcessHandle::IO, buf, sizeof(buf)) <= 0)
+        return;
+
+    for (char* line = buf; line && *line;) {
+        if (std::strncmp(line, "read_bytes: ", 12) == 0)
+            total_read = std::strtoull(line + 12, nullptr, 10);
+        else if (std::strncmp(line, "write_bytes: ", 13) == 0)
+            total_write = std::strtoull(line + 13, nullptr, 10);
+
+        line = std::strchr(line, '\n');
 
-    for (std::string line; std::getline(stats.stream, line);) {
-        if (line.substr(0, 11) == "read_bytes:") {
-            total_read = try_stoull(line.substr(12));
-        }
-        else if (line.substr(0, 12) == "write_bytes:") {
-            total_write = try_stoull(line.substr(13));
-        }
+        if (line)
+            line++;
     }
 
     using namespace std::chrono;
@@ -70,25 +63,21 @@ void IOStats::poll_pid(pid_t pid) {
     stats.last_update = now;
 }
 
-void IOStats::poll() {
-    std::set<pid_t> pids_to_delete;
-
-    for (auto& p : pids) {
-        pid_t pid = p.first;
-
-        if (!std::filesystem::exists("/proc/" + std::to_string(pid)))
-            pids_to_delete.insert(pid);
-        else
-            poll_pid(pid);
-    }
+void IOStats::remove_pid(pid_t pid) {
+    SPDLOG_TRACE("deleting pid {}", pid);
+    pids.erase(pid);
+}
 
-    for (const auto& p : pids_to_delete) {
-        SPDLOG_TRACE("deleting pid {}", p);
-        pids.erase(p);
-    }
+void IOStats::poll() {
+    for (auto& p : pids)
+        poll_pid(p.first);
 }
 
 io_stats_t IOStats::get_stats(pid_t pid) {
-    _io_stats& stats = pids[pid];
-    return { stats.read_mb_per_sec, stats.write_mb_per_sec };
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return {};
+
+    return { it->second.read_mb_per_sec, it->second.write_mb_per_sec };
 }
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <map>
-#include <fstream>
+#include <memory>
 #include <chrono>
 #include <cstdint>
 #include <sys/types.h>
 
 #include "../common/gpu_metrics.hpp"
+#include "process.hpp"
 
 class IOStats {
 private:
@@ -18,7 +19,7 @@ private:
         uint64_t previous_write_bytes = 0;
 
         std::chrono::time_point<std::chrono::steady_clock> last_update;
-        std::ifstream stream;
+        std::shared_ptr<ProcessHandle> process;
     };
 
     std::map<pid_t, _io_stats> pids;
@@ -26,7 +27,8 @@ private:
     void poll_pid(pid_t pid);
 
 public:
-    void add_pid(pid_t pid);
+    void add_pid(const std::shared_ptr<ProcessHandle>& process);
+    void remove_pid(pid_t pid);
     void poll();
     io_stats_t get_stats(pid_t pid);
 };
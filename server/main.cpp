@@ -2,6 +2,7 @@
 #include <chrono>
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
 #include <utility>
 #include <chrono>
 #include <filesystem>
@@ -17,12 +18,16 @@
 #include "fdinfo.hpp"
 #include "../common/socket.hpp"
 #include "memory.hpp"
+#include "pressure.hpp"
+#include "cgroup.hpp"
 #include "cpu/cpu.hpp"
+#include "cpu/process_cpu.hpp"
 #include "iostats.hpp"
 #include "api.hpp"
-
-std::mutex current_metrics_lock;
-metrics current_metrics;
+#include "process.hpp"
+#include "process_tree.hpp"
+#include "process_tracker.hpp"
+#include "poll_metrics.hpp"
 
 std::atomic<bool> should_exit = false;
 
@@ -50,112 +55,7 @@ spdlog::level::level_enum get_log_level() {
         return spdlog::level::debug;
 }
 
-void poll_metrics(CPU& cpu, GPUS& gpus, IOStats& iostats) {
-    metrics m = {};
-
-    {
-        std::unique_lock lock(current_metrics_lock);
-        m = current_metrics;
-    }
-
-    {
-        std::set<pid_t> pids_to_delete;
-
-        for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
-            pid_t pid = proc.first;
-
-            if (!std::filesystem::exists("/proc/" + std::to_string(pid)))
-                pids_to_delete.insert(pid);
-        }
-
-        for (const auto& p : pids_to_delete) {
-            SPDLOG_TRACE("deleting pid {}", p);
-            m.pids.erase(p);
-        }
-    }
-
-    // ====START CPU INFO===========================================================
-    cpu.poll();
-
-    m.cpu = cpu.get_info();
-
-    uint16_t num_of_cores = 0;
-    for (core_info_t core : cpu.get_core_info()) {
-        m.cores[num_of_cores] = core;
-        num_of_cores++;
-    }
-
-    m.num_of_cores = num_of_cores;
-    // ====END CPU INFO=============================================================
-
-    // ====START GPU INFO===========================================================
-    uint8_t num_of_gpus = 0;
-
-    for (std::shared_ptr<GPU>& gpu : gpus.available_gpus) {
-        m.gpus[num_of_gpus] = gpu->get_system_metrics();
-        num_of_gpus++;
-
-        if (m.gpus[num_of_gpus].is_apu) {
-            float apu_power = m.gpus[num_of_gpus].apu_cpu_power;
-            int apu_temp  = m.gpus[num_of_gpus].apu_cpu_temp;
-
-            // maybe make it configurable
-            if (apu_power > m.cpu.power)
-                m.cpu.power = apu_power;
-
-            if (apu_temp > m.cpu.temp)
-                m.cpu.temp = apu_temp;
-        }
-    }
-
-    m.num_of_gpus = num_of_gpus;
-
-    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
-        const pid_t pid = proc.first;
-        num_of_gpus = 0;
-
-        for (std::shared_ptr<GPU>& gpu : gpus.available_gpus)
-            m.pids[pid].gpus[num_of_gpus++] = gpu->get_process_metrics(pid);
-    }
-    // ====END GPU INFO=============================================================
-
-    // ====START MEMORY INFO========================================================
-    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
-        pid_t pid = proc.first;
-
-        std::map<std::string, float> mem_stats = get_process_memory(pid);
-        m.pids[pid].memory = {
-            .resident = mem_stats["resident"],
-            .shared = mem_stats["shared"],
-            .virt = mem_stats["virtual"]
-        };
-    }
-
-    std::map<std::string, float> ram_stats = get_ram_info();
-
-    m.memory = {
-        .used = ram_stats["used"],
-        .total = ram_stats["total"],
-        .swap_used = ram_stats["swap_used"],
-    };
-    // ====END MEMORY INFO==========================================================
-
-    // ====START IO INFO============================================================
-    iostats.poll();
-
-    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
-        pid_t pid = proc.first;
-        m.pids[pid].io_stats = iostats.get_stats(pid);
-    }
-    // ====END IO INFO==============================================================
-
-    {
-        std::unique_lock lock(current_metrics_lock);
-        current_metrics = m;
-    }
-}
-
-mangohud_message form_mangohud_message(pid_t pid) {
+mangohud_message form_mangohud_message(pid_t pid, Pressure& pressure) {
     metrics m = {};
     mangohud_message msg = {};
 
@@ -181,11 +81,29 @@ mangohud_message form_mangohud_message(pid_t pid) {
 
         .process_resident = proc_metrics.memory.resident,
         .process_shared = proc_metrics.memory.shared,
-        .process_virtual = proc_metrics.memory.virt
+        .process_virtual = proc_metrics.memory.virt,
+
+        .process_pss = proc_metrics.memory.pss,
+        .process_swap = proc_metrics.memory.swap,
+        .process_anon = proc_metrics.memory.anon,
+        .process_file = proc_metrics.memory.file,
+
+        .process_minor_faults_per_sec = proc_metrics.memory.minor_faults_per_sec,
+        .process_major_faults_per_sec = proc_metrics.memory.major_faults_per_sec
     };
 
     msg.io_stats = proc_metrics.io_stats;
+
+    msg.pressure = m.pressure;
+    msg.cgroup_pressure = proc_metrics.cgroup_pressure;
+    msg.num_of_stall_events = pressure.take_client_events(
+        pid, msg.stall_events, sizeof(msg.stall_events) / sizeof(msg.stall_events[0])
+    );
+
     msg.cpu = m.cpu;
+    msg.process_cpu = proc_metrics.cpu;
+    msg.process_group = proc_metrics.group;
+    msg.cgroup = proc_metrics.cgroup;
     msg.num_of_cores = m.num_of_cores;
     std::memcpy(&msg.cores, &m.cores, sizeof(m.cores));
 
@@ -271,13 +189,35 @@ int main() {
         return -1;
     }
 
-    std::vector<pollfd> poll_fds = {
-        { .fd = sock, .events = POLLIN }
-    };
+    // number of top GPU consumers among all processes to report per GPU
+    const char* gpu_top = getenv("MANGOHUD_GPU_TOP");
+
+    if (gpu_top && std::atoi(gpu_top) > 0)
+        drm_clients.enable_system_scan(std::atoi(gpu_top));
 
     GPUS gpus;
     CPU cpu;
+    ProcessCPU process_cpu;
+    MemInfo meminfo;
+    VmStat vmstat;
+    ProcessMemory process_memory;
+    Pressure pressure;
+    CgroupStats cgroup_stats;
     IOStats iostats;
+    ProcessRegistry processes;
+    ProcessTree process_tree;
+
+    ProcessTracker tracker(
+        gpus, process_cpu, process_memory, pressure,
+        cgroup_stats, iostats, processes, process_tree
+    );
+
+    std::vector<pollfd> poll_fds = {
+        { .fd = sock, .events = POLLIN },
+        { .fd = processes.get_fd(), .events = POLLIN },
+        { .fd = pressure.get_fd(), .events = POLLIN },
+        { .fd = process_tree.get_fd(), .events = POLLIN }
+    };
 
     std::chrono::time_point<std::chrono::steady_clock> last_stats_poll;
 
@@ -289,7 +229,14 @@ int main() {
             std::chrono::steady_clock().now();
 
         if (cur_time - last_stats_poll > 500ms) {
-            poll_metrics(cpu, gpus, iostats);
+            processes.check_processes_without_pidfd();
+            tracker.update_groups();
+            // proc connector is only polled while process trees are in use
+            poll_fds[3].fd = process_tree.get_fd();
+            poll_metrics(
+                cpu, process_cpu, gpus, meminfo, vmstat, process_memory,
+                pressure, cgroup_stats, iostats, processes, process_tree
+            );
             last_stats_poll = cur_time;
         }
 
@@ -324,6 +271,12 @@ int main() {
 
                 fds_to_add.push_back({.fd = ret, .events = POLLIN});
                 SPDLOG_INFO("Accepted new connection: fd={}", ret);
+            } else if (fd->fd == processes.get_fd()) {
+                processes.handle_exits();
+            } else if (fd->fd == pressure.get_fd()) {
+                pressure.handle_events();
+            } else if (fd->fd == process_tree.get_fd()) {
+                process_tree.handle_events();
             } else {
                 if (fd->revents & POLLHUP || fd->revents & POLLNVAL) {
                     fds_to_close.insert(fd);
@@ -331,28 +284,11 @@ int main() {
                 }
 
                 size_t pid = 0;
-                if (receive_message_with_creds(fd->fd, pid)) {
-                    bool pid_exists = false;
-
-                    {
-                        std::unique_lock lock(current_metrics_lock);
-                        pid_exists = current_metrics.pids.find(pid) != current_metrics.pids.end();
-                    }
-
-                    if (!pid_exists) {
-                        iostats.add_pid(pid);
-
-                        for (auto& gpu : gpus.available_gpus) {
-                            gpu->add_pid(pid);
-
-                            if (FDInfo* ptr = dynamic_cast<FDInfo*>(gpu.get()))
-                                ptr->fdinfo.add_pid(pid);
-                        }
-
-                        current_metrics.pids.try_emplace(pid, process_metrics());
-                    }
+                std::string payload;
+                if (receive_message_with_creds(fd->fd, pid, payload)) {
+                    tracker.track_client(pid, parse_subscriptions(payload));
 
-                    mangohud_message msg = form_mangohud_message(pid);
+                    mangohud_message msg = form_mangohud_message(pid, pressure);
                     send_message(fd->fd, msg);
                 }
             }
@@ -1,79 +1,372 @@
-#include <map>
-#include <fstream>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <fcntl.h>
 #include <unistd.h>
 #include "spdlog/spdlog.h"
 #include "memory.hpp"
+#include "../common/log_errno.hpp"
 
-std::map<std::string, float> get_ram_info() {
-    std::map<std::string, float> ret = {
-        { "total"       , 0.f },
-        { "used"        , 0.f },
-        { "swap_used"   , 0.f } 
+const char* const MemInfo::field_names[FIELD_COUNT] = {
+    "MemTotal",
+    "MemAvailable",
+    "Buffers",
+    "Cached",
+    "SwapTotal",
+    "SwapFree",
+    "Zswap",
+    "Zswapped",
+    "Dirty",
+    "Writeback",
+    "AnonPages",
+    "Shmem",
+    "CommitLimit",
+    "Committed_AS",
+    "AnonHugePages",
+    "HugePages_Total",
+    "HugePages_Free",
+    "Hugepagesize"
+};
+
+MemInfo::MemInfo() {
+    fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        LOG_UNIX_ERRNO_ERROR("can't open /proc/meminfo.");
+
+    for (ssize_t& offset : offsets)
+        offset = -1;
+}
+
+MemInfo::~MemInfo() {
+    if (fd >= 0)
+        close(fd);
+}
+
+void MemInfo::find_offsets(ssize_t len) {
+    for (ssize_t& offset : offsets)
+        offset = -1;
+
+    const char* line = buf;
+
+    while (line && line < buf + len) {
+        const char* colon = std::strchr(line, ':');
+
+        if (!colon)
+            break;
+
+        size_t key_len = colon - line;
+
+        for (size_t i = 0; i < FIELD_COUNT; i++) {
+            if (std::strlen(field_names[i]) == key_len &&
+                std::strncmp(line, field_names[i], key_len) == 0) {
+                offsets[i] = line - buf;
+                break;
+            }
+        }
+
+        line = std::strchr(colon, '\n');
+
+        if (line)
+            line++;
+    }
+
+    has_offsets = true;
+}
+
+bool MemInfo::offsets_match(ssize_t len) const {
+    for (size_t i = 0; i < FIELD_COUNT; i++) {
+        if (offsets[i] < 0)
+            continue;
+
+        size_t key_len = std::strlen(field_names[i]);
+
+        if (offsets[i] + static_cast<ssize_t>(key_len) >= len)
+            return false;
+
+        const char* key = buf + offsets[i];
+
+        if (std::strncmp(key, field_names[i], key_len) != 0 || key[key_len] != ':')
+            return false;
+    }
+
+    return true;
+}
+
+void MemInfo::poll() {
+    if (fd < 0)
+        return;
+
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if (len <= 0) {
+        LOG_UNIX_ERRNO_ERROR("can't read /proc/meminfo.");
+        return;
+    }
+
+    buf[len] = '\0';
+
+    if (!has_offsets || !offsets_match(len)) {
+        SPDLOG_DEBUG("meminfo: (re)computing field offsets");
+        find_offsets(len);
+    }
+
+    for (size_t i = 0; i < FIELD_COUNT; i++) {
+        if (offsets[i] < 0)
+            continue;
+
+        const char* value = buf + offsets[i] + std::strlen(field_names[i]) + 1;
+        values[i] = std::strtoull(value, nullptr, 10);
+    }
+
+    auto to_gib = [](uint64_t kb) {
+        return kb / 1024.f / 1024.f;
     };
 
-    std::ifstream file("/proc/meminfo");
-    std::map<std::string, float> meminfo;
+    info.total          = to_gib(values[MEM_TOTAL]);
+    info.used           = to_gib(values[MEM_TOTAL] - values[MEM_AVAILABLE]);
+    info.swap_used      = to_gib(values[SWAP_TOTAL] - values[SWAP_FREE]);
 
-    if (!file.is_open()) {
-        SPDLOG_ERROR("can't open /proc/meminfo");
-        return ret;
+    info.cached         = to_gib(values[CACHED]);
+    info.buffers        = to_gib(values[BUFFERS]);
+    info.dirty          = to_gib(values[DIRTY]);
+    info.writeback      = to_gib(values[WRITEBACK]);
+    info.anon           = to_gib(values[ANON_PAGES]);
+    info.shmem          = to_gib(values[SHMEM]);
+
+    info.anon_hugepages = to_gib(values[ANON_HUGE_PAGES]);
+    info.hugetlb_total  = to_gib(values[HUGEPAGES_TOTAL] * values[HUGEPAGESIZE]);
+    info.hugetlb_free   = to_gib(values[HUGEPAGES_FREE] * values[HUGEPAGESIZE]);
+
+    info.zswap          = to_gib(values[ZSWAP]);
+    info.zswapped       = to_gib(values[ZSWAPPED]);
+
+    info.committed      = to_gib(values[COMMITTED_AS]);
+    info.commit_limit   = to_gib(values[COMMIT_LIMIT]);
+}
+
+const VmStat::counter_desc VmStat::counter_descs[COUNTER_COUNT] = {
+    { "pswpin",             false },
+    { "pswpout",            false },
+    { "pgmajfault",         false },
+    { "compact_stall",      false },
+    { "allocstall",         true  },
+    { "thp_fault_fallback", false },
+    { "workingset_refault", true  }
+};
+
+VmStat::VmStat() {
+    fd = open("/proc/vmstat", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        LOG_UNIX_ERRNO_ERROR("can't open /proc/vmstat.");
+}
+
+VmStat::~VmStat() {
+    if (fd >= 0)
+        close(fd);
+}
+
+void VmStat::poll() {
+    if (fd < 0)
+        return;
+
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+    if (len <= 0) {
+        LOG_UNIX_ERRNO_ERROR("can't read /proc/vmstat.");
+        return;
     }
 
-    for (std::string line; std::getline(file, line);) {
-        std::string key = line.substr(0, line.find(":"));
-        std::string val = line.substr(key.length() + 2);
-        meminfo[key] = std::stoull(val) / 1024.f / 1024.f;
+    buf[len] = '\0';
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t current[COUNTER_COUNT] = {};
+
+    // "name value" lines
+    for (const char* line = buf; line && *line;) {
+        const char* space = std::strchr(line, ' ');
+
+        if (!space)
+            break;
+
+        size_t name_len = space - line;
+
+        for (size_t i = 0; i < COUNTER_COUNT; i++) {
+            const counter_desc& c = counter_descs[i];
+            size_t key_len = std::strlen(c.name);
+
+            if (std::strncmp(line, c.name, key_len) != 0)
+                continue;
+
+            if (name_len == key_len || (c.is_prefix && line[key_len] == '_')) {
+                current[i] += std::strtoull(space + 1, nullptr, 10);
+                break;
+            }
+        }
+
+        line = std::strchr(space, '\n');
+
+        if (line)
+            line++;
     }
 
-    ret["total"]        = meminfo["MemTotal"];
-    ret["used"]         = meminfo["MemTotal"]  - meminfo["MemAvailable"];
-    ret["swap_used"]    = meminfo["SwapTotal"] - meminfo["SwapFree"];
+    if (has_previous) {
+        float seconds = std::chrono::duration<float>(now - previous_time).count();
 
-    return ret;
+        auto rate = [&](counter c) {
+            if (seconds <= 0.f || current[c] < previous[c])
+                return 0.f;
+
+            return (current[c] - previous[c]) / seconds;
+        };
+
+        rates = {
+            .pswpin             = rate(PSWPIN),
+            .pswpout            = rate(PSWPOUT),
+            .pgmajfault         = rate(PGMAJFAULT),
+            .compact_stall      = rate(COMPACT_STALL),
+            .allocstall         = rate(ALLOCSTALL),
+            .thp_fault_fallback = rate(THP_FAULT_FALLBACK),
+            .workingset_refault = rate(WORKINGSET_REFAULT)
+        };
+    }
+
+    std::memcpy(previous, current, sizeof(previous));
+    previous_time = now;
+    has_previous = true;
 }
 
-std::map<std::string, float> get_process_memory(pid_t pid)
+process_memory_t get_process_memory(const ProcessHandle& process)
 {
-    std::map<std::string, float> ret = {
-        { "resident", 0 },
-        { "shared"  , 0 },
-        { "virtual" , 0 } 
-    };
+    process_memory_t ret = {};
 
     // https://man7.org/linux/man-pages/man3/sysconf.3.html
     // PAGESIZE - _SC_PAGESIZE
     // Size of a page in bytes.  Must not be less than 1.
     long page_size = sysconf(_SC_PAGESIZE);
 
-    std::string f = "/proc/" + std::to_string(pid) + "/statm";
+    char buf[128];
 
-    std::ifstream file(f);
-
-    if (!file.is_open()) {
-        SPDLOG_ERROR("can't open {}", f);
+    if (process.read(ProcessHandle::STATM, buf, sizeof(buf)) <= 0) {
+        SPDLOG_DEBUG("can't read statm of pid {}", process.pid);
         return ret;
     }
 
-    size_t last_idx = 0;
-    std::string line;
-    std::getline(file, line);
+    std::array<uint64_t, 3> meminfo;
+    char* pos = buf;
 
-    if (line.empty())
-        return ret;
+    for (auto i = 0; i < 3; i++)
+        meminfo[i] = std::strtoull(pos, &pos, 10) * page_size;
 
-    std::array<uint64_t, 3> meminfo;
+    ret.resident    = meminfo[1];
+    ret.shared      = meminfo[2];
+    ret.virt        = meminfo[0];
+
+    return ret;
+}
+
+void ProcessMemory::add_pid(const std::shared_ptr<ProcessHandle>& process) {
+    if (pids.find(process->pid) != pids.end())
+        return;
+
+    SPDLOG_DEBUG("adding pid {} to process memory", process->pid);
+    pids[process->pid].process = process;
+}
+
+void ProcessMemory::remove_pid(pid_t pid) {
+    pids.erase(pid);
+}
+
+void ProcessMemory::poll_faults(_process_memory& p) {
+    char buf[1024];
 
-    for (auto i = 0; i < 3; i++) {
-        auto idx = line.find(" ", last_idx);
-        auto val = line.substr(last_idx, idx);
+    if (p.process->read(ProcessHandle::STAT, buf, sizeof(buf)) <= 0)
+        return;
 
-        meminfo[i] = std::stoull(val) * page_size;
-        last_idx = idx + 1;
+    // (10) minflt, (12) majflt
+    uint64_t fields[13] = {};
+
+    if (!parse_stat(buf, fields, 13))
+        return;
+
+    uint64_t minor_faults = fields[10];
+    uint64_t major_faults = fields[12];
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (p.has_previous_faults) {
+        float seconds = std::chrono::duration<float>(now - p.last_faults_update).count();
+
+        if (seconds > 0.f) {
+            p.details.minor_faults_per_sec = (minor_faults - p.previous_minor_faults) / seconds;
+            p.details.major_faults_per_sec = (major_faults - p.previous_major_faults) / seconds;
+        }
     }
 
-    ret["resident"] = meminfo[1];
-    ret["shared"]   = meminfo[2];
-    ret["virtual"]  = meminfo[0];
+    p.has_previous_faults = true;
+    p.previous_minor_faults = minor_faults;
+    p.previous_major_faults = major_faults;
+    p.last_faults_update = now;
+}
 
-    return ret;
+void ProcessMemory::poll_deep(_process_memory& p) {
+    auto now = std::chrono::steady_clock::now();
+    bool subscribed = p.process->subscriptions & SUBSCRIBE_DEEP_MEMORY;
+
+    if (p.has_deep && !subscribed && now - p.last_deep_update < deep_interval)
+        return;
+
+    p.has_deep = true;
+    p.last_deep_update = now;
+
+    char buf[2048];
+
+    if (p.process->read(ProcessHandle::SMAPS_ROLLUP, buf, sizeof(buf)) <= 0) {
+        SPDLOG_TRACE("can't read smaps_rollup of pid {}", p.process->pid);
+        return;
+    }
+
+    // "Pss:                 123 kB"
+    // Pss_Anon and Pss_File are available since linux 5.7
+    for (char* line = buf; line && *line;) {
+        char* colon = std::strchr(line, ':');
+
+        if (!colon)
+            break;
+
+        float value = std::strtoull(colon + 1, nullptr, 10) * 1024.f;
+        std::string_view key(line, colon - line);
+
+        if (key == "Pss")
+            p.details.pss = value;
+        else if (key == "Swap")
+            p.details.swap = value;
+        else if (key == "Pss_Anon")
+            p.details.anon = value;
+        else if (key == "Pss_File")
+            p.details.file = value;
+
+        line = std::strchr(colon, '\n');
+
+        if (line)
+            line++;
+    }
+}
+
+void ProcessMemory::poll() {
+    for (auto& p : pids) {
+        poll_faults(p.second);
+        poll_deep(p.second);
+    }
+}
+
+process_memory_details_t ProcessMemory::get_stats(pid_t pid) const {
+    auto it = pids.find(pid);
+
+    if (it == pids.end())
+        return {};
+
+    return it->second.details;
 }
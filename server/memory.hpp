@@ -1,4 +1,160 @@
 #pragma once
 
-std::map<std::string, float> get_ram_info();
-std::map<std::string, float> get_process_memory(pid_t pid);
+#include <map>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "process.hpp"
+#include "../common/gpu_metrics.hpp"
+
+struct process_memory_t {
+    float resident  = 0.f;
+    float shared    = 0.f;
+    float virt      = 0.f;
+};
+
+// /proc/meminfo keeps the same layout for the whole uptime, so after the
+// first full parse every field is read straight from its remembered offset.
+// Offsets are validated on each read and recomputed if the layout changes.
+class MemInfo {
+private:
+    enum field {
+        MEM_TOTAL,
+        MEM_AVAILABLE,
+        BUFFERS,
+        CACHED,
+        SWAP_TOTAL,
+        SWAP_FREE,
+        ZSWAP,
+        ZSWAPPED,
+        DIRTY,
+        WRITEBACK,
+        ANON_PAGES,
+        SHMEM,
+        COMMIT_LIMIT,
+        COMMITTED_AS,
+        ANON_HUGE_PAGES,
+        HUGEPAGES_TOTAL,
+        HUGEPAGES_FREE,
+        HUGEPAGESIZE,
+        FIELD_COUNT
+    };
+
+    static const char* const field_names[FIELD_COUNT];
+
+    int fd = -1;
+    char buf[8192];
+
+    // -1 if field is not present on this kernel
+    ssize_t offsets[FIELD_COUNT];
+    bool has_offsets = false;
+
+    // in kB, except HugePages_Total and HugePages_Free which are page counts
+    uint64_t values[FIELD_COUNT] = {};
+
+    system_memory_t info = {};
+
+    void find_offsets(ssize_t len);
+    bool offsets_match(ssize_t len) const;
+
+public:
+    MemInfo();
+    ~MemInfo();
+
+    MemInfo(const MemInfo&) = delete;
+    MemInfo& operator=(const MemInfo&) = delete;
+
+    void poll();
+    const system_memory_t& get_info() const { return info; }
+};
+
+// Per-second rates of paging, swap and reclaim counters from /proc/vmstat.
+// Newer kernels split some counters per zone or per LRU type
+// (allocstall_normal, workingset_refault_anon, ...), those are summed.
+class VmStat {
+private:
+    enum counter {
+        PSWPIN,
+        PSWPOUT,
+        PGMAJFAULT,
+        COMPACT_STALL,
+        ALLOCSTALL,
+        THP_FAULT_FALLBACK,
+        WORKINGSET_REFAULT,
+        COUNTER_COUNT
+    };
+
+    struct counter_desc {
+        const char* name;
+        bool is_prefix;
+    };
+
+    static const counter_desc counter_descs[COUNTER_COUNT];
+
+    int fd = -1;
+    char buf[16384];
+
+    bool has_previous = false;
+    uint64_t previous[COUNTER_COUNT] = {};
+    std::chrono::time_point<std::chrono::steady_clock> previous_time;
+
+    vmstat_t rates = {};
+
+public:
+    VmStat();
+    ~VmStat();
+
+    VmStat(const VmStat&) = delete;
+    VmStat& operator=(const VmStat&) = delete;
+
+    void poll();
+    const vmstat_t& get_rates() const { return rates; }
+};
+
+// in bytes
+struct process_memory_details_t {
+    float pss       = 0.f;
+    float swap      = 0.f;
+    float anon      = 0.f;
+    float file      = 0.f;
+
+    float minor_faults_per_sec = 0.f;
+    float major_faults_per_sec = 0.f;
+};
+
+// Fault rates come from /proc/<pid>/stat and are updated every tick.
+// smaps_rollup walks all mappings of the process under mmap lock, so it's
+// read every deep_interval, or every tick if the client subscribed to it.
+class ProcessMemory {
+private:
+    struct _process_memory {
+        process_memory_details_t details;
+
+        bool has_previous_faults = false;
+        uint64_t previous_minor_faults = 0;
+        uint64_t previous_major_faults = 0;
+        std::chrono::time_point<std::chrono::steady_clock> last_faults_update;
+
+        bool has_deep = false;
+        std::chrono::time_point<std::chrono::steady_clock> last_deep_update;
+
+        std::shared_ptr<ProcessHandle> process;
+    };
+
+    const std::chrono::seconds deep_interval = std::chrono::seconds(5);
+
+    std::map<pid_t, _process_memory> pids;
+
+    void poll_faults(_process_memory& p);
+    void poll_deep(_process_memory& p);
+
+public:
+    void add_pid(const std::shared_ptr<ProcessHandle>& process);
+    void remove_pid(pid_t pid);
+    void poll();
+    process_memory_details_t get_stats(pid_t pid) const;
+};
+
+process_memory_t get_process_memory(const ProcessHandle& process);
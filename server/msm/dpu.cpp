@@ -3,7 +3,7 @@
 MSM_DPU::MSM_DPU(
     const std::string& drm_node, const std::string& pci_dev,
     uint16_t vendor_id, uint16_t device_id
-) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-msm-dpu"), FDInfo(drm_node) {
+) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-msm-dpu"), FDInfo(drm_node, pci_dev) {
     hwmon.base_dir = hwmon.find_hwmon_dir_by_name("gpu");
     hwmon.setup(sensors, drm_node);
 }
@@ -18,22 +18,11 @@ int MSM_DPU::get_temperature() {
 }
 
 int MSM_DPU::get_process_load(pid_t pid) {
-    uint64_t* previous_gpu_time = &previous_gpu_times[pid];
+    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, gpu_time_key);
 
-    uint64_t gpu_time_now = fdinfo.get_gpu_time(pid, "drm-engine-gpu");
-
-    if (!*previous_gpu_time) {
-        *previous_gpu_time = gpu_time_now;
-        return 0;
-    }
-
-    float delta_gpu_time = gpu_time_now - *previous_gpu_time;
-    float result = delta_gpu_time / delta_time_ns.count() * 100;
-
-    if (result > 100.f)
-        result = 100.f;
-
-    *previous_gpu_time = gpu_time_now;
+    return get_gpu_time_load(fdinfo, pid, gpu_time_now);
+}
 
-    return std::round(result);
+void MSM_DPU::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    fdinfo.get_engine_loads(pid, engines);
 }
@@ -12,7 +12,7 @@ private:
         { "temp", "temp1_input" }
     };
 
-    std::map<pid_t, uint64_t> previous_gpu_times;
+    const fdinfo_key gpu_time_key = drm_clients.get_key("drm-engine-gpu");
 
 protected:
     void pre_poll_overrides() override;
@@ -28,4 +28,5 @@ public:
 
     // Process-related functions
     int     get_process_load(pid_t pid)         override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
 };
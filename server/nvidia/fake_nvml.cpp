@@ -0,0 +1,512 @@
+// Stand-in for libnvidia-ml.so.1 which implements everything libnvml_loader
+// loads, so Nvidia backend can be run and measured without Nvidia GPU:
+//
+//     MANGOHUD_NVML_LIBRARY=/path/to/libnvidia-ml-fake.so mangohud-server
+//
+// Every device asked for by pci bus id exists. Values follow a triangle wave
+// with a period of MANGOHUD_FAKE_NVML_PERIOD seconds (10 by default) and gpu
+// is power throttled in the second half of every period, which is reported
+// as a clock event. Other knobs:
+//
+//     MANGOHUD_FAKE_NVML_LATENCY_US   sleep in every call, real NVML takes
+//                                     a global lock and talks to the kernel
+//     MANGOHUD_FAKE_NVML_PIDS         comma separated pids reported as
+//                                     graphics processes
+//     MANGOHUD_FAKE_NVML_XID          xid error every that many seconds
+//     MANGOHUD_FAKE_NVML_STATS        print number of calls of every
+//                                     function on exit
+//
+// Tests get the same counts with fake_nvml_get_calls().
+
+#define NVML_NO_UNVERSIONED_FUNC_DEFS
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nvml.h"
+
+struct nvmlDevice_st {
+    unsigned int index;
+    std::string bus_id;
+};
+
+struct nvmlUnit_st {};
+
+struct nvmlEventSet_st {
+    struct registration {
+        nvmlDevice_t device;
+        unsigned long long types;
+        bool throttled;
+        unsigned long long xid_count;
+    };
+
+    std::mutex mutex;
+    std::vector<registration> devices;
+};
+
+struct counter {
+    const char* name;
+    std::atomic<uint64_t> calls;
+};
+
+static struct {
+    double period = 10.;
+    std::chrono::microseconds latency = {};
+    std::vector<unsigned int> pids;
+    double xid_interval = 0.;
+    bool stats = false;
+} config;
+
+static const unsigned int max_devices = 8;
+
+static std::mutex devices_mutex;
+static std::vector<std::unique_ptr<nvmlDevice_st>> devices;
+static std::chrono::time_point<std::chrono::steady_clock> start_time = std::chrono::steady_clock::now();
+
+static counter counters[64];
+static std::atomic<size_t> num_of_counters = 0;
+
+static counter* register_counter(const char* name) {
+    counter* c = &counters[num_of_counters++ % (sizeof(counters) / sizeof(counters[0]))];
+    c->name = name;
+
+    return c;
+}
+
+static struct stats_printer {
+    ~stats_printer() {
+        if (!config.stats)
+            return;
+
+        for (size_t i = 0; i < num_of_counters; i++)
+            std::fprintf(stderr, "fake nvml: %-45s %10lu\n", counters[i].name, counters[i].calls.load());
+    }
+} printer;
+
+#define FAKE_NVML_CALL()                                            \
+    do {                                                            \
+        static counter* c = register_counter(__func__);             \
+        c->calls++;                                                 \
+        if (config.latency.count())                                 \
+            std::this_thread::sleep_for(config.latency);            \
+    } while (0)
+
+static double seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// position within period, devices are out of phase with each other
+static double phase(nvmlDevice_t device) {
+    return std::fmod(seconds() + device->index * 1.7, config.period) / config.period;
+}
+
+// 0 -> 1 -> 0 over a period
+static double wave(nvmlDevice_t device) {
+    return 1. - std::fabs(2. * phase(device) - 1.);
+}
+
+static bool is_throttled(nvmlDevice_t device) {
+    return phase(device) >= 0.5;
+}
+
+static unsigned int power_usage(nvmlDevice_t device) {
+    return 20'000 + 280'000 * wave(device);
+}
+
+static unsigned int temperature(nvmlDevice_t device) {
+    return 35 + 45 * wave(device);
+}
+
+static unsigned long long xid_count() {
+    if (config.xid_interval <= 0.)
+        return 0;
+
+    return seconds() / config.xid_interval;
+}
+
+extern "C" {
+
+// number of calls of NVML function name so far
+uint64_t fake_nvml_get_calls(const char* name) {
+    for (size_t i = 0; i < num_of_counters; i++)
+        if (std::strcmp(counters[i].name, name) == 0)
+            return counters[i].calls;
+
+    return 0;
+}
+
+nvmlReturn_t nvmlInit_v2(void) {
+    FAKE_NVML_CALL();
+
+    if (const char* s = std::getenv("MANGOHUD_FAKE_NVML_PERIOD"))
+        config.period = std::max(std::atof(s), 0.1);
+
+    if (const char* s = std::getenv("MANGOHUD_FAKE_NVML_LATENCY_US"))
+        config.latency = std::chrono::microseconds(std::atoi(s));
+
+    if (const char* s = std::getenv("MANGOHUD_FAKE_NVML_XID"))
+        config.xid_interval = std::atof(s);
+
+    config.stats = std::getenv("MANGOHUD_FAKE_NVML_STATS");
+    config.pids.clear();
+
+    for (const char* s = std::getenv("MANGOHUD_FAKE_NVML_PIDS"); s && *s;) {
+        config.pids.push_back(std::strtoul(s, nullptr, 10));
+
+        const char* comma = std::strchr(s, ',');
+        s = comma ? comma + 1 : nullptr;
+    }
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlShutdown(void) {
+    FAKE_NVML_CALL();
+    return NVML_SUCCESS;
+}
+
+const char* nvmlErrorString(nvmlReturn_t result) {
+    FAKE_NVML_CALL();
+
+    switch (result) {
+        case NVML_SUCCESS:                  return "Success";
+        case NVML_ERROR_INVALID_ARGUMENT:   return "Invalid Argument";
+        case NVML_ERROR_NOT_SUPPORTED:      return "Not Supported";
+        case NVML_ERROR_NOT_FOUND:          return "Not Found";
+        case NVML_ERROR_INSUFFICIENT_SIZE:  return "Insufficient Size";
+        case NVML_ERROR_TIMEOUT:            return "Timeout";
+        default:                            return "Unknown Error";
+    }
+}
+
+nvmlReturn_t nvmlDeviceGetCount_v2(unsigned int* deviceCount) {
+    FAKE_NVML_CALL();
+
+    std::unique_lock lock(devices_mutex);
+    *deviceCount = devices.size();
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetHandleByIndex_v2(unsigned int index, nvmlDevice_t* device) {
+    FAKE_NVML_CALL();
+
+    std::unique_lock lock(devices_mutex);
+
+    if (index >= devices.size())
+        return NVML_ERROR_INVALID_ARGUMENT;
+
+    *device = devices[index].get();
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetHandleByPciBusId_v2(const char* pciBusId, nvmlDevice_t* device) {
+    FAKE_NVML_CALL();
+
+    std::unique_lock lock(devices_mutex);
+
+    for (auto& d : devices) {
+        if (d->bus_id == pciBusId) {
+            *device = d.get();
+            return NVML_SUCCESS;
+        }
+    }
+
+    if (devices.size() >= max_devices)
+        return NVML_ERROR_NOT_FOUND;
+
+    devices.push_back(std::make_unique<nvmlDevice_st>());
+    devices.back()->index = devices.size() - 1;
+    devices.back()->bus_id = pciBusId;
+
+    *device = devices.back().get();
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetPciInfo_v3(nvmlDevice_t device, nvmlPciInfo_t* pci) {
+    FAKE_NVML_CALL();
+
+    *pci = {};
+    std::snprintf(pci->busId, sizeof(pci->busId), "%s", device->bus_id.c_str());
+    std::snprintf(pci->busIdLegacy, sizeof(pci->busIdLegacy), "%s", device->bus_id.c_str());
+    pci->pciDeviceId = 0x2684'10de;
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetUtilizationRates(nvmlDevice_t device, nvmlUtilization_t* utilization) {
+    FAKE_NVML_CALL();
+
+    utilization->gpu = 100 * wave(device);
+    utilization->memory = 60 * wave(device);
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetMemoryInfo(nvmlDevice_t device, nvmlMemory_t* memory) {
+    FAKE_NVML_CALL();
+
+    memory->total = 8ULL << 30;
+    memory->used = (1ULL << 30) + (6ULL << 30) * wave(device);
+    memory->free = memory->total - memory->used;
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetClockInfo(nvmlDevice_t device, nvmlClockType_t type, unsigned int* clock) {
+    FAKE_NVML_CALL();
+
+    switch (type) {
+        case NVML_CLOCK_GRAPHICS:
+        case NVML_CLOCK_SM:
+            *clock = 210 + 2310 * wave(device);
+            return NVML_SUCCESS;
+
+        case NVML_CLOCK_MEM:
+            *clock = 405 + 10'096 * wave(device);
+            return NVML_SUCCESS;
+
+        default:
+            return NVML_ERROR_NOT_SUPPORTED;
+    }
+}
+
+nvmlReturn_t nvmlDeviceGetTemperature(nvmlDevice_t device, nvmlTemperatureSensors_t sensorType, unsigned int* temp) {
+    FAKE_NVML_CALL();
+
+    if (sensorType != NVML_TEMPERATURE_GPU)
+        return NVML_ERROR_NOT_SUPPORTED;
+
+    *temp = temperature(device);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetPowerUsage(nvmlDevice_t device, unsigned int* power) {
+    FAKE_NVML_CALL();
+
+    *power = power_usage(device);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetPowerManagementLimit(nvmlDevice_t device, unsigned int* limit) {
+    FAKE_NVML_CALL();
+
+    *limit = 300'000;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetPowerSource(nvmlDevice_t device, nvmlPowerSource_t* powerSource) {
+    FAKE_NVML_CALL();
+
+    *powerSource = NVML_POWER_SOURCE_AC;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetCurrentClocksThrottleReasons(nvmlDevice_t device, unsigned long long* clocksThrottleReasons) {
+    FAKE_NVML_CALL();
+
+    if (is_throttled(device))
+        *clocksThrottleReasons = nvmlClocksEventReasonSwPowerCap;
+    else if (wave(device) < 0.05)
+        *clocksThrottleReasons = nvmlClocksEventReasonGpuIdle;
+    else
+        *clocksThrottleReasons = nvmlClocksEventReasonNone;
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetFanSpeed(nvmlDevice_t device, unsigned int* speed) {
+    FAKE_NVML_CALL();
+
+    *speed = 30 + 50 * wave(device);
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlUnitGetHandleByIndex(unsigned int index, nvmlUnit_t* unit) {
+    FAKE_NVML_CALL();
+    return NVML_ERROR_NOT_SUPPORTED;
+}
+
+nvmlReturn_t nvmlUnitGetFanSpeedInfo(nvmlUnit_t unit, nvmlUnitFanSpeeds_t* fanSpeeds) {
+    FAKE_NVML_CALL();
+    return NVML_ERROR_NOT_SUPPORTED;
+}
+
+static nvmlReturn_t get_processes(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_v1_t* infos) {
+    if (*infoCount < config.pids.size()) {
+        *infoCount = config.pids.size();
+        return NVML_ERROR_INSUFFICIENT_SIZE;
+    }
+
+    *infoCount = config.pids.size();
+
+    for (size_t i = 0; i < config.pids.size(); i++) {
+        infos[i].pid = config.pids[i];
+        infos[i].usedGpuMemory = (256ULL << 20) * (i + 1);
+    }
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetGraphicsRunningProcesses(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_v1_t* infos) {
+    FAKE_NVML_CALL();
+    return get_processes(device, infoCount, infos);
+}
+
+nvmlReturn_t nvmlDeviceGetComputeRunningProcesses(nvmlDevice_t device, unsigned int* infoCount, nvmlProcessInfo_v1_t* infos) {
+    FAKE_NVML_CALL();
+
+    *infoCount = 0;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetProcessUtilization(
+    nvmlDevice_t device, nvmlProcessUtilizationSample_t* utilization,
+    unsigned int* processSamplesCount, unsigned long long lastSeenTimeStamp
+) {
+    FAKE_NVML_CALL();
+
+    // cpu timestamp in us, like the real one
+    unsigned long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+
+    if (config.pids.empty() || now <= lastSeenTimeStamp)
+        return NVML_ERROR_NOT_FOUND;
+
+    if (!utilization || *processSamplesCount < config.pids.size()) {
+        *processSamplesCount = config.pids.size();
+        return NVML_ERROR_INSUFFICIENT_SIZE;
+    }
+
+    *processSamplesCount = config.pids.size();
+
+    for (size_t i = 0; i < config.pids.size(); i++) {
+        nvmlProcessUtilizationSample_t& s = utilization[i];
+
+        s.pid = config.pids[i];
+        s.timeStamp = now;
+        s.smUtil = 100 * wave(device) / config.pids.size();
+        s.memUtil = 60 * wave(device) / config.pids.size();
+        s.encUtil = 0;
+        s.decUtil = i == 0 ? 20 : 0;
+    }
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetFieldValues(nvmlDevice_t device, int valuesCount, nvmlFieldValue_t* values) {
+    FAKE_NVML_CALL();
+
+    long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+
+    for (int i = 0; i < valuesCount; i++) {
+        nvmlFieldValue_t& v = values[i];
+
+        v.timestamp = now;
+        v.latencyUsec = config.latency.count();
+        v.valueType = NVML_VALUE_TYPE_UNSIGNED_INT;
+        v.nvmlReturn = NVML_SUCCESS;
+
+        switch (v.fieldId) {
+            case NVML_FI_DEV_POWER_INSTANT:
+                v.value.uiVal = power_usage(device);
+                break;
+
+            case NVML_FI_DEV_POWER_CURRENT_LIMIT:
+                v.value.uiVal = 300'000;
+                break;
+
+            case NVML_FI_DEV_MEMORY_TEMP:
+                v.value.uiVal = temperature(device) + 10;
+                break;
+
+            default:
+                v.nvmlReturn = NVML_ERROR_NOT_SUPPORTED;
+                break;
+        }
+    }
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlEventSetCreate(nvmlEventSet_t* set) {
+    FAKE_NVML_CALL();
+
+    *set = new nvmlEventSet_st;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlEventSetFree(nvmlEventSet_t set) {
+    FAKE_NVML_CALL();
+
+    delete set;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceGetSupportedEventTypes(nvmlDevice_t device, unsigned long long* eventTypes) {
+    FAKE_NVML_CALL();
+
+    *eventTypes = nvmlEventTypeClock | nvmlEventTypeXidCriticalError | nvmlEventTypePowerSourceChange;
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlDeviceRegisterEvents(nvmlDevice_t device, unsigned long long eventTypes, nvmlEventSet_t set) {
+    FAKE_NVML_CALL();
+
+    std::unique_lock lock(set->mutex);
+    set->devices.push_back({ device, eventTypes, is_throttled(device), xid_count() });
+
+    return NVML_SUCCESS;
+}
+
+nvmlReturn_t nvmlEventSetWait_v2(nvmlEventSet_t set, nvmlEventData_t* data, unsigned int timeoutms) {
+    FAKE_NVML_CALL();
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutms);
+
+    do {
+        {
+            std::unique_lock lock(set->mutex);
+
+            for (auto& r : set->devices) {
+                *data = {};
+                data->device = r.device;
+                data->gpuInstanceId = 0xFFFFFFFF;
+                data->computeInstanceId = 0xFFFFFFFF;
+
+                if ((r.types & nvmlEventTypeClock) && is_throttled(r.device) != r.throttled) {
+                    r.throttled = !r.throttled;
+                    data->eventType = nvmlEventTypeClock;
+                    return NVML_SUCCESS;
+                }
+
+                if ((r.types & nvmlEventTypeXidCriticalError) && xid_count() != r.xid_count) {
+                    r.xid_count = xid_count();
+                    data->eventType = nvmlEventTypeXidCriticalError;
+                    // graphics engine exception
+                    data->eventData = 13;
+                    return NVML_SUCCESS;
+                }
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    } while (std::chrono::steady_clock::now() < deadline);
+
+    return NVML_ERROR_TIMEOUT;
+}
+
+}
@@ -1,5 +1,22 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <pthread.h>
 #include "nvidia.hpp"
 
+static NVMLWorker nvml_worker;
+
+// clock event reasons which are reported as throttling, everything
+// but nvmlClocksEventReasonGpuIdle
+static const unsigned long long throttle_reasons_mask = 0x00000000000001FELL;
+
+static uint64_t monotonic_ns() {
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1'000'000'000ULL + ts.tv_nsec;
+}
+
 Nvidia::Nvidia(
     const std::string &drm_node, const std::string &pci_dev,
     uint16_t vendor_id, uint16_t device_id)
@@ -9,6 +26,14 @@ Nvidia::Nvidia(
     nvml_available = init_nvml(pci_dev);
 }
 
+Nvidia::~Nvidia() {
+    nvml_worker.remove_gpu(this);
+}
+
+void Nvidia::start_thread_worker() {
+    nvml_worker.add_gpu(this);
+}
+
 bool Nvidia::init_nvml(const std::string& pci_dev) {
     nvml = get_libnvml_loader();
 
@@ -32,153 +57,316 @@ bool Nvidia::init_nvml(const std::string& pci_dev) {
         return false;
     }
 
+    fields[FIELD_POWER_USAGE].fieldId = NVML_FI_DEV_POWER_INSTANT;
+    fields[FIELD_POWER_LIMIT].fieldId = NVML_FI_DEV_POWER_CURRENT_LIMIT;
+    fields[FIELD_MEMORY_TEMP].fieldId = NVML_FI_DEV_MEMORY_TEMP;
+
+    nvmlMemory_t nvml_memory;
+
+    if (nvml->nvmlDeviceGetMemoryInfo(device, &nvml_memory) == NVML_SUCCESS)
+        memory_total = nvml_memory.total;
+
+    if (nvml->nvmlDeviceGetPowerManagementLimit(device, &power_limit) != NVML_SUCCESS)
+        power_limit = 0;
+
     return true;
 }
 
-const std::vector<nvmlProcessInfo_v1_t> Nvidia::get_processes() {
-    unsigned int info_count = 0;
+void Nvidia::read_device() {
+    if (nvml->nvmlDeviceGetFieldValues(device, FIELD_COUNT, fields) != NVML_SUCCESS)
+        for (nvmlFieldValue_t& f : fields)
+            f.nvmlReturn = NVML_ERROR_UNKNOWN;
 
-    std::vector<nvmlProcessInfo_v1_t> cur_process_info(info_count);
-    nvmlReturn_t ret = nvml->nvmlDeviceGetGraphicsRunningProcesses(device, &info_count, cur_process_info.data());
+    if (nvml->nvmlDeviceGetUtilizationRates(device, &utilization) != NVML_SUCCESS)
+        utilization = {};
 
-    if (ret != NVML_ERROR_INSUFFICIENT_SIZE)
-        return {};
+    if (nvml->nvmlDeviceGetMemoryInfo(device, &memory) != NVML_SUCCESS)
+        memory = {};
 
-    cur_process_info.resize(info_count);
-    ret = nvml->nvmlDeviceGetGraphicsRunningProcesses(device, &info_count, cur_process_info.data());
+    if (nvml->nvmlDeviceGetClockInfo(device, NVML_CLOCK_GRAPHICS, &core_clock) != NVML_SUCCESS)
+        core_clock = 0;
 
-    if (ret != NVML_SUCCESS)
-        return {};
+    if (nvml->nvmlDeviceGetClockInfo(device, NVML_CLOCK_MEM, &memory_clock) != NVML_SUCCESS)
+        memory_clock = 0;
+
+    if (nvml->nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature) != NVML_SUCCESS)
+        temperature = 0;
 
-    return cur_process_info;
+    if (nvml->nvmlDeviceGetFanSpeed(device, &fan_speed) != NVML_SUCCESS)
+        fan_speed = 0;
+
+    if (nvml->nvmlDeviceGetCurrentClocksThrottleReasons(device, &throttle_reasons) != NVML_SUCCESS)
+        throttle_reasons = 0;
+
+    std::unique_lock lock(events_mutex);
+    throttle_reasons |= event_throttle_reasons;
+    event_throttle_reasons = 0;
 }
 
-int Nvidia::get_load() {
-    nvmlUtilization_st nvml_utilization;
+void Nvidia::register_events(nvmlEventSet_t set) {
+    unsigned long long types = 0;
 
-    nvmlReturn_t ret = nvml->nvmlDeviceGetUtilizationRates(device, &nvml_utilization);
+    if (nvml->nvmlDeviceGetSupportedEventTypes(device, &types) != NVML_SUCCESS)
+        return;
 
-    if (ret != NVML_SUCCESS)
-        return 0;
+    types &= nvmlEventTypeClock | nvmlEventTypeXidCriticalError | nvmlEventTypePowerSourceChange;
+
+    if (!types)
+        return;
+
+    nvmlReturn_t ret = nvml->nvmlDeviceRegisterEvents(device, types, set);
+
+    if (ret != NVML_SUCCESS) {
+        SPDLOG_DEBUG("{}: failed to register NVML events: {}", drm_node, nvml->nvmlErrorString(ret));
+        return;
+    }
 
-    return nvml_utilization.gpu;
+    SPDLOG_DEBUG("{}: registered NVML events {:#x}", drm_node, types);
 }
 
-float Nvidia::get_vram_used() {
-    nvmlMemory_st nvml_memory;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetMemoryInfo(device, &nvml_memory);
+void Nvidia::handle_event(uint64_t timestamp_ns, const nvmlEventData_t& data) {
+    if (data.device != device)
+        return;
 
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
-    return nvml_memory.used / 1024.f / 1024.f / 1024.f;
+    gpu_event_t event = {};
+    event.timestamp_ns = timestamp_ns;
+
+    if (data.eventType & nvmlEventTypeClock) {
+        // event doesn't say why clocks changed
+        unsigned long long reasons = 0;
+
+        if (nvml->nvmlDeviceGetCurrentClocksThrottleReasons(device, &reasons) != NVML_SUCCESS)
+            return;
+
+        event.type = GPU_EVENT_THROTTLE;
+        event.data = reasons & throttle_reasons_mask;
+    } else if (data.eventType & nvmlEventTypeXidCriticalError) {
+        SPDLOG_WARN("{}: Xid {}", drm_node, data.eventData);
+
+        event.type = GPU_EVENT_XID;
+        event.data = data.eventData;
+    } else if (data.eventType & nvmlEventTypePowerSourceChange) {
+        nvmlPowerSource_t source = 0;
+
+        if (nvml->nvmlDeviceGetPowerSource)
+            nvml->nvmlDeviceGetPowerSource(device, &source);
+
+        event.type = GPU_EVENT_POWER_SOURCE;
+        event.data = source;
+    } else {
+        return;
+    }
+
+    std::unique_lock lock(events_mutex);
+
+    if (event.type == GPU_EVENT_THROTTLE) {
+        event_throttle_reasons |= event.data;
+
+        // clocks change all the time, only changes of throttling matter
+        if (event.data == last_throttle_reasons)
+            return;
+
+        last_throttle_reasons = event.data;
+    }
+
+    event_history[num_of_events++ % (sizeof(event_history) / sizeof(event_history[0]))] = event;
 }
 
-float Nvidia::get_memory_total() {
-    nvmlMemory_st nvml_memory;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetMemoryInfo(device, &nvml_memory);
+uint8_t Nvidia::get_events(gpu_event_t* out, uint8_t max) {
+    std::unique_lock lock(events_mutex);
+
+    const uint64_t size = sizeof(event_history) / sizeof(event_history[0]);
+    uint64_t count = std::min({ num_of_events, size, static_cast<uint64_t>(max) });
+
+    for (uint64_t i = 0; i < count; i++)
+        out[i] = event_history[(num_of_events - count + i) % size];
+
+    return count;
+}
+
+// -1 if field is not supported
+double Nvidia::get_field(field f) const {
+    const nvmlFieldValue_t& v = fields[f];
+
+    if (v.nvmlReturn != NVML_SUCCESS)
+        return -1;
+
+    switch (v.valueType) {
+        case NVML_VALUE_TYPE_DOUBLE:                return v.value.dVal;
+        case NVML_VALUE_TYPE_UNSIGNED_INT:          return v.value.uiVal;
+        case NVML_VALUE_TYPE_UNSIGNED_LONG:         return v.value.ulVal;
+        case NVML_VALUE_TYPE_UNSIGNED_LONG_LONG:    return v.value.ullVal;
+        case NVML_VALUE_TYPE_SIGNED_LONG_LONG:      return v.value.sllVal;
+        case NVML_VALUE_TYPE_SIGNED_INT:            return v.value.siVal;
+        default:                                    return -1;
+    }
+}
+
+void Nvidia::pre_poll_overrides() {
+    read_device();
+
+    processes.clear();
+
+    read_processes(nvml->nvmlDeviceGetGraphicsRunningProcesses);
+    read_processes(nvml->nvmlDeviceGetComputeRunningProcesses);
+    read_utilization();
+}
+
+Nvidia::process_info& Nvidia::find_process(pid_t pid) {
+    for (process_info& p : processes)
+        if (p.pid == pid)
+            return p;
+
+    processes.push_back({});
+    processes.back().pid = pid;
+
+    return processes.back();
+}
+
+const Nvidia::process_info* Nvidia::get_process(pid_t pid) const {
+    for (const process_info& p : processes)
+        if (p.pid == pid)
+            return &p;
+
+    return nullptr;
+}
+
+// appends graphics or compute processes to the table
+void Nvidia::read_processes(decltype(libnvml_loader::nvmlDeviceGetGraphicsRunningProcesses) get) {
+    unsigned int count = process_buf.size();
+    nvmlReturn_t ret = get(device, &count, process_buf.data());
+
+    // buffer is kept between ticks, so this only happens
+    // when there are more processes than ever before
+    if (ret == NVML_ERROR_INSUFFICIENT_SIZE) {
+        process_buf.resize(count + 8);
+        count = process_buf.size();
+        ret = get(device, &count, process_buf.data());
+    }
 
     if (ret != NVML_SUCCESS)
-        return 0;
-    
-    return nvml_memory.total / 1024.f / 1024.f / 1024.f;
+        return;
+
+    for (unsigned int i = 0; i < count; i++) {
+        const nvmlProcessInfo_v1_t& info = process_buf[i];
+        process_info& p = find_process(info.pid);
+
+        // process which does both graphics and compute is in both
+        // lists with the same memory usage
+        if (info.usedGpuMemory != static_cast<unsigned long long>(NVML_VALUE_NOT_AVAILABLE))
+            p.vram_used = std::max(p.vram_used, info.usedGpuMemory);
+    }
 }
 
-int Nvidia::get_memory_clock() {
-    uint32_t memory_clock;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetClockInfo(device, NVML_CLOCK_MEM, &memory_clock);
+void Nvidia::read_utilization() {
+    unsigned int count = utilization_buf.size();
+    nvmlReturn_t ret = nvml->nvmlDeviceGetProcessUtilization(
+        device, utilization_buf.data(), &count, last_utilization_timestamp
+    );
+
+    if (ret == NVML_ERROR_INSUFFICIENT_SIZE) {
+        utilization_buf.resize(count + 8);
+        count = utilization_buf.size();
+        ret = nvml->nvmlDeviceGetProcessUtilization(
+            device, utilization_buf.data(), &count, last_utilization_timestamp
+        );
+    }
 
+    // NVML_ERROR_NOT_FOUND means nothing ran since previous tick
     if (ret != NVML_SUCCESS)
-        return 0;
-    
+        return;
+
+    // there can be several samples per process since last timestamp
+    for (unsigned int i = 0; i < count; i++) {
+        const nvmlProcessUtilizationSample_t& s = utilization_buf[i];
+        process_info& p = find_process(s.pid);
+
+        p.samples++;
+        p.sm_util += s.smUtil;
+        p.mem_util += s.memUtil;
+        p.enc_util += s.encUtil;
+        p.dec_util += s.decUtil;
+
+        last_utilization_timestamp = std::max(last_utilization_timestamp, s.timeStamp);
+    }
+
+    for (process_info& p : processes) {
+        if (p.samples < 2)
+            continue;
+
+        p.sm_util /= p.samples;
+        p.mem_util /= p.samples;
+        p.enc_util /= p.samples;
+        p.dec_util /= p.samples;
+    }
+}
+
+int Nvidia::get_load() {
+    return utilization.gpu;
+}
+
+float Nvidia::get_vram_used() {
+    return memory.used / 1024.f / 1024.f / 1024.f;
+}
+
+float Nvidia::get_memory_total() {
+    return memory_total / 1024.f / 1024.f / 1024.f;
+}
+
+int Nvidia::get_memory_clock() {
     return memory_clock;
 }
 
-int Nvidia::get_temperature() {
-    uint32_t temperature = 0;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temperature);
+int Nvidia::get_memory_temp() {
+    return std::max(get_field(FIELD_MEMORY_TEMP), 0.);
+}
 
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
+int Nvidia::get_temperature() {
     return temperature;
 }
 
 int Nvidia::get_core_clock() {
-    uint32_t core_clock = 0;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetClockInfo(device, NVML_CLOCK_GRAPHICS, &core_clock);
-
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
     return core_clock;
 }
 
 float Nvidia::get_power_usage() {
-    uint32_t power_usage = 0;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetPowerUsage(device, &power_usage);
+    double power_usage = get_field(FIELD_POWER_USAGE);
+
+    // power fields are there since r530
+    if (power_usage < 0) {
+        unsigned int mw = 0;
+
+        if (nvml->nvmlDeviceGetPowerUsage(device, &mw) == NVML_SUCCESS)
+            power_usage = mw;
+        else
+            power_usage = 0;
+    }
 
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
     return power_usage / 1000.f;
 }
 
 float Nvidia::get_power_limit() {
-    uint32_t power_limit = 0;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetPowerManagementLimit(device, &power_limit);
+    double limit = get_field(FIELD_POWER_LIMIT);
 
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
-    return power_limit / 1000.f;
+    if (limit < 0)
+        limit = power_limit;
+
+    return limit / 1000.f;
 }
 
 bool Nvidia::get_is_power_throttled() {
-    unsigned long long throttle_reasons;
-    nvmlReturn_t ret = nvml->nvmlDeviceGetCurrentClocksThrottleReasons(device, &throttle_reasons);
-
-    if (ret != NVML_SUCCESS)
-        return 0;
-
     return (throttle_reasons & 0x000000000000008CLL) != 0;
 }
 
 bool Nvidia::get_is_temp_throttled() {
-    unsigned long long throttle_reasons;
-    nvmlReturn_t ret = nvml->nvmlDeviceGetCurrentClocksThrottleReasons(device, &throttle_reasons);
-
-    if (ret != NVML_SUCCESS)
-        return 0;
-
     return (throttle_reasons & 0x0000000000000060LL) != 0;
 }
 
 bool Nvidia::get_is_other_throttled() {
-    unsigned long long throttle_reasons;
-    nvmlReturn_t ret = nvml->nvmlDeviceGetCurrentClocksThrottleReasons(device, &throttle_reasons);
-
-    if (ret != NVML_SUCCESS)
-        return 0;
-
     return (throttle_reasons & 0x0000000000000112LL) != 0;
 }
 
 int Nvidia::get_fan_speed() {
-    uint32_t fan_speed = 0;
-    
-    nvmlReturn_t ret = nvml->nvmlDeviceGetFanSpeed(device, &fan_speed);
-
-    if (ret != NVML_SUCCESS)
-        return 0;
-    
     return fan_speed;
 }
 
@@ -186,17 +374,137 @@ bool Nvidia::get_fan_rpm() {
     return false;
 }
 
+int Nvidia::get_process_load(pid_t pid) {
+    const process_info* p = get_process(pid);
+
+    if (!p)
+        return 0;
+
+    return std::min(p->sm_util, 100u);
+}
+
 float Nvidia::get_process_vram_used(pid_t pid) {
-    const std::vector<nvmlProcessInfo_v1_t> info = get_processes();
-    float used_memory = 0.f;
+    const process_info* p = get_process(pid);
 
-    for (const nvmlProcessInfo_v1_t& proc : info) {
-        if (static_cast<pid_t>(proc.pid) != pid)
-            continue;
+    if (!p)
+        return 0.f;
+
+    return p->vram_used / 1024.f / 1024.f / 1024.f;
+}
+
+void Nvidia::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    const process_info* p = get_process(pid);
+
+    engines.num_of_engines = 0;
+
+    if (!p)
+        return;
+
+    const std::pair<const char*, unsigned int> utils[] = {
+        { "sm"      , p->sm_util  },
+        { "memory"  , p->mem_util },
+        { "encoder" , p->enc_util },
+        { "decoder" , p->dec_util },
+    };
+
+    for (const auto& u : utils) {
+        gpu_engine_t& e = engines.engines[engines.num_of_engines++];
+        std::snprintf(e.name, sizeof(e.name), "%s", u.first);
+        e.load = std::min(u.second, 100u);
+    }
+}
+
+NVMLWorker::~NVMLWorker() {
+    stop();
+}
+
+void NVMLWorker::add_gpu(Nvidia* gpu) {
+    std::unique_lock lock(mutex);
+    gpus.push_back(gpu);
+
+    if (!nvml)
+        nvml = get_libnvml_loader();
+
+    if (!event_set && nvml->nvmlEventSetCreate(&event_set) != NVML_SUCCESS)
+        event_set = nullptr;
+
+    if (event_set)
+        gpu->register_events(event_set);
+
+    if (thread.joinable())
+        return;
+
+    stop_thread = false;
+    thread = std::thread(&NVMLWorker::poll, this);
+    pthread_setname_np(thread.native_handle(), "gpu-nvidia");
+
+    if (!event_set)
+        return;
+
+    event_thread = std::thread(&NVMLWorker::wait_events, this);
+    pthread_setname_np(event_thread.native_handle(), "gpu-nvidia-evt");
+}
+
+void NVMLWorker::remove_gpu(Nvidia* gpu) {
+    {
+        std::unique_lock lock(mutex);
+        gpus.erase(std::remove(gpus.begin(), gpus.end(), gpu), gpus.end());
+
+        if (!gpus.empty())
+            return;
+    }
+
+    stop();
+}
 
-        used_memory = proc.usedGpuMemory / 1024.f / 1024.f / 1024.f;
-        break;
+void NVMLWorker::stop() {
+    stop_thread = true;
+
+    if (thread.joinable())
+        thread.join();
+
+    if (event_thread.joinable())
+        event_thread.join();
+
+    if (event_set) {
+        nvml->nvmlEventSetFree(event_set);
+        event_set = nullptr;
     }
+}
+
+void NVMLWorker::poll() {
+    while (!stop_thread) {
+        {
+            std::unique_lock lock(mutex);
+
+            for (Nvidia* gpu : gpus)
+                gpu->poll_once();
+        }
 
-    return used_memory;
+        std::this_thread::sleep_for(1s);
+    }
+}
+
+void NVMLWorker::wait_events() {
+    nvmlEventData_t data;
+
+    while (!stop_thread) {
+        // short timeout to notice stop_thread
+        nvmlReturn_t ret = nvml->nvmlEventSetWait_v2(event_set, &data, 500);
+
+        if (ret == NVML_ERROR_TIMEOUT)
+            continue;
+
+        if (ret != NVML_SUCCESS) {
+            SPDLOG_DEBUG("nvmlEventSetWait failed: {}", nvml->nvmlErrorString(ret));
+            std::this_thread::sleep_for(1s);
+            continue;
+        }
+
+        uint64_t timestamp_ns = monotonic_ns();
+        std::unique_lock lock(mutex);
+
+        for (Nvidia* gpu : gpus)
+            gpu->handle_event(timestamp_ns, data);
+    }
 }
@@ -2,6 +2,10 @@
 
 #include <cstdint>
 #include <utility>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include "gpu.hpp"
 #include "nvml_loader.hpp"
 
@@ -11,13 +15,81 @@ private:
     nvmlDevice_t device = nullptr;
     bool init_nvml(const std::string& pci_dev);
 
-    const std::vector<nvmlProcessInfo_v1_t> get_processes();
+    // values which have field ids, read with one nvmlDeviceGetFieldValues()
+    enum field {
+        FIELD_POWER_USAGE,
+        FIELD_POWER_LIMIT,
+        FIELD_MEMORY_TEMP,
+        FIELD_COUNT
+    };
+
+    nvmlFieldValue_t fields[FIELD_COUNT] = {};
+
+    // the rest is read once per tick by read_device(),
+    // zero if reading failed
+    nvmlUtilization_t utilization;
+    nvmlMemory_t memory;
+    unsigned int core_clock;
+    unsigned int memory_clock;
+    unsigned int temperature;
+    unsigned int fan_speed;
+    unsigned long long throttle_reasons;
+
+    // static, read on init
+    unsigned long long memory_total = 0;
+    // fallback for drivers without power fields
+    unsigned int power_limit = 0;
+
+    void read_device();
+    double get_field(field f) const;
+
+    // filled by event thread of NVMLWorker
+    std::mutex events_mutex;
+    gpu_event_t event_history[64];
+    uint64_t num_of_events = 0;
+    // reasons seen in clock events since previous tick, so throttling
+    // shorter than a tick is still reported
+    unsigned long long event_throttle_reasons = 0;
+    unsigned long long last_throttle_reasons = 0;
+
+    // every process using the gpu, refreshed once per tick
+    struct process_info {
+        pid_t pid;
+        unsigned long long vram_used;
+
+        unsigned int samples;
+        unsigned int sm_util;
+        unsigned int mem_util;
+        unsigned int enc_util;
+        unsigned int dec_util;
+    };
+
+    std::vector<process_info> processes;
+    std::vector<nvmlProcessInfo_v1_t> process_buf;
+    std::vector<nvmlProcessUtilizationSample_t> utilization_buf;
+    // cpu timestamp of the newest utilization sample, in us
+    unsigned long long last_utilization_timestamp = 0;
+
+    process_info& find_process(pid_t pid);
+    const process_info* get_process(pid_t pid) const;
+    void read_processes(decltype(libnvml_loader::nvmlDeviceGetGraphicsRunningProcesses) get);
+    void read_utilization();
+
+protected:
+    void pre_poll_overrides() override;
 
 public:
     Nvidia(
         const std::string& drm_node, const std::string& pci_dev,
         uint16_t vendor_id, uint16_t device_id
     );
+    ~Nvidia();
+
+    // polled by shared NVML worker instead of own thread
+    void start_thread_worker() override;
+
+    void register_events(nvmlEventSet_t set);
+    void handle_event(uint64_t timestamp_ns, const nvmlEventData_t& data);
 
     bool nvml_available = false;
 
@@ -28,6 +100,7 @@ public:
 
     float   get_memory_total()  override;
     int     get_memory_clock()  override;
+    int     get_memory_temp()   override;
 
     int     get_temperature()   override;
 
@@ -44,6 +117,35 @@ public:
     bool    get_fan_rpm()       override;
 
     // Process-related functions
-    // int     get_process_load(pid_t pid)         { return 0; }
-    float   get_process_vram_used(pid_t pid) override;
+    int     get_process_load(pid_t pid)         override;
+    float   get_process_vram_used(pid_t pid)    override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
+
+    uint8_t get_events(gpu_event_t* out, uint8_t max) override;
+};
+
+// Polls all Nvidia GPUs from one thread. NVML serializes calls from
+// different threads anyway, so a thread per GPU only adds contention.
+// Throttling, xid errors and power source changes of all GPUs are
+// waited for on one event set by another thread.
+class NVMLWorker {
+private:
+    std::mutex mutex;
+    std::vector<Nvidia*> gpus;
+    std::thread thread;
+    std::thread event_thread;
+    std::atomic<bool> stop_thread = false;
+
+    std::shared_ptr<libnvml_loader> nvml;
+    nvmlEventSet_t event_set = nullptr;
+
+    void poll();
+    void wait_events();
+    void stop();
+
+public:
+    ~NVMLWorker();
+
+    void add_gpu(Nvidia* gpu);
+    void remove_gpu(Nvidia* gpu);
 };
@@ -1,4 +1,5 @@
 #include "nvml_loader.hpp"
+#include <cstdlib>
 #include <dlfcn.h>
 #include <spdlog/spdlog.h>
 
@@ -13,6 +14,11 @@ std::shared_ptr<libnvml_loader> get_libnvml_loader()
 }
 
 libnvml_loader::libnvml_loader() {
+    if (const char* path = getenv("MANGOHUD_NVML_LIBRARY")) {
+        SPDLOG_INFO("Using NVML library \"{}\"", path);
+        library_name = path;
+    }
+
     load();
 }
 
@@ -29,6 +35,13 @@ libnvml_loader::~libnvml_loader() {
         } \
     } while(0)
 
+#define LOAD_NVML_FUNCTION_OPTIONAL(name) \
+    do {                    \
+        name = reinterpret_cast<decltype(this->name)>(dlsym(library_, #name)); \
+        if (!name) \
+            SPDLOG_DEBUG("{} doesn't have {}", library_name, #name); \
+    } while(0)
+
 bool libnvml_loader::load() {
     if (loaded_)
         return true;
@@ -58,12 +71,23 @@ bool libnvml_loader::load() {
     LOAD_NVML_FUNCTION(nvmlUnitGetHandleByIndex);
     LOAD_NVML_FUNCTION(nvmlDeviceGetFanSpeed);
     LOAD_NVML_FUNCTION(nvmlDeviceGetGraphicsRunningProcesses);
+    LOAD_NVML_FUNCTION(nvmlDeviceGetComputeRunningProcesses);
+    LOAD_NVML_FUNCTION(nvmlDeviceGetProcessUtilization);
+    LOAD_NVML_FUNCTION(nvmlDeviceGetFieldValues);
+    LOAD_NVML_FUNCTION(nvmlEventSetCreate);
+    LOAD_NVML_FUNCTION(nvmlEventSetFree);
+    LOAD_NVML_FUNCTION(nvmlEventSetWait_v2);
+    LOAD_NVML_FUNCTION(nvmlDeviceRegisterEvents);
+    LOAD_NVML_FUNCTION(nvmlDeviceGetSupportedEventTypes);
+
+    LOAD_NVML_FUNCTION_OPTIONAL(nvmlDeviceGetPowerSource);
 
     loaded_ = true;
     return true;
 }
 
 #undef LOAD_NVML_FUNCTION
+#undef LOAD_NVML_FUNCTION_OPTIONAL
 
 void libnvml_loader::unload() {
     if (library_) {
@@ -91,4 +115,13 @@ void libnvml_loader::unload() {
     nvmlUnitGetHandleByIndex = nullptr;
     nvmlDeviceGetFanSpeed = nullptr;
     nvmlDeviceGetGraphicsRunningProcesses = nullptr;
+    nvmlDeviceGetComputeRunningProcesses = nullptr;
+    nvmlDeviceGetProcessUtilization = nullptr;
+    nvmlDeviceGetFieldValues = nullptr;
+    nvmlEventSetCreate = nullptr;
+    nvmlEventSetFree = nullptr;
+    nvmlEventSetWait_v2 = nullptr;
+    nvmlDeviceRegisterEvents = nullptr;
+    nvmlDeviceGetSupportedEventTypes = nullptr;
+    nvmlDeviceGetPowerSource = nullptr;
 }
@@ -33,12 +33,24 @@ public:
     decltype(&::nvmlUnitGetHandleByIndex) nvmlUnitGetHandleByIndex;
     decltype(&::nvmlDeviceGetFanSpeed) nvmlDeviceGetFanSpeed;
     decltype(&::nvmlDeviceGetGraphicsRunningProcesses) nvmlDeviceGetGraphicsRunningProcesses;
+    decltype(&::nvmlDeviceGetComputeRunningProcesses) nvmlDeviceGetComputeRunningProcesses;
+    decltype(&::nvmlDeviceGetProcessUtilization) nvmlDeviceGetProcessUtilization;
+    decltype(&::nvmlDeviceGetFieldValues) nvmlDeviceGetFieldValues;
+    decltype(&::nvmlEventSetCreate) nvmlEventSetCreate;
+    decltype(&::nvmlEventSetFree) nvmlEventSetFree;
+    decltype(&::nvmlEventSetWait_v2) nvmlEventSetWait_v2;
+    decltype(&::nvmlDeviceRegisterEvents) nvmlDeviceRegisterEvents;
+    decltype(&::nvmlDeviceGetSupportedEventTypes) nvmlDeviceGetSupportedEventTypes;
+
+    // optional, null if driver is too old
+    decltype(&::nvmlDeviceGetPowerSource) nvmlDeviceGetPowerSource;
 
 private:
     void unload();
     void* library_ = nullptr;
 
-    const std::string library_name = "libnvidia-ml.so.1";
+    // MANGOHUD_NVML_LIBRARY overrides it, e.g. with libnvidia-ml-fake.so
+    std::string library_name = "libnvidia-ml.so.1";
     std::atomic<bool> loaded_ = false;
 
     // Disallow copy constructor and assignment operator.
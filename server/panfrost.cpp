@@ -3,7 +3,7 @@
 Panfrost::Panfrost(
     const std::string& drm_node, const std::string& pci_dev,
     uint16_t vendor_id, uint16_t device_id
-) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-panfrost"), FDInfo(drm_node) {
+) : GPU(drm_node, pci_dev, vendor_id, device_id, "gpu-panfrost"), FDInfo(drm_node, pci_dev) {
     hwmon.base_dir = hwmon.find_hwmon_dir_by_name("gpu_thermal");
     hwmon.setup(sensors, drm_node);
 }
@@ -22,46 +22,32 @@ int Panfrost::get_core_clock() {
         return 0;
 
     // frequency is the same across all pids, so just take first pid
-    FDInfoBase& data = fdinfo.pids.begin()->second;
-    std::vector<fdinfo_data>& fds_data = data.fds_data;
+    std::vector<fdinfo_data>& fds_data = fdinfo.pids.begin()->second;
 
     if (fds_data.empty())
         return 0;
 
-    std::string freq_str = fds_data[0]["drm-curfreq-fragment"];
+    uint64_t freq = 0;
 
-    if (freq_str.empty())
+    if (!fds_data[0].get(freq_key, freq))
         return 0;
 
-    float freq = std::stoull(freq_str) / 1'000'000;
-
-    return std::round(freq);
+    return std::round(freq / 1'000'000.f);
 }
 
 int Panfrost::get_process_load(pid_t pid) {
-    uint64_t* previous_gpu_time = &previous_gpu_times[pid];
-
-    uint64_t fragment_time_now = fdinfo.get_gpu_time(pid, "drm-engine-fragment");
-    uint64_t vertex_time_now   = fdinfo.get_gpu_time(pid, "drm-engine-vertex-tiler");
+    uint64_t fragment_time_now = fdinfo.get_gpu_time(pid, fragment_time_key);
+    uint64_t vertex_time_now   = fdinfo.get_gpu_time(pid, vertex_time_key);
 
     uint64_t gpu_time_now = fragment_time_now + vertex_time_now;
 
-    if (!*previous_gpu_time) {
-        *previous_gpu_time = gpu_time_now;
-        return 0;
-    }
-
-    float delta_gpu_time = gpu_time_now - *previous_gpu_time;
-    float result = delta_gpu_time / delta_time_ns.count() * 100;
-
-    if (result > 100.f)
-        result = 100.f;
-
-    *previous_gpu_time = gpu_time_now;
-
-    return std::round(result);
+    return get_gpu_time_load(fdinfo, pid, gpu_time_now);
 }
 
 float Panfrost::get_process_vram_used(pid_t pid) {
-    return fdinfo.get_memory_used(pid, "drm-resident-memory");
+    return fdinfo.get_memory_used(pid, memory_key);
+}
+
+void Panfrost::get_process_engines(pid_t pid, gpu_engines_t& engines) {
+    fdinfo.get_engine_loads(pid, engines);
 }
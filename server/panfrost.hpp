@@ -12,7 +12,10 @@ private:
         { "temp", "temp1_input" }
     };
 
-    std::map<pid_t, uint64_t> previous_gpu_times;
+    const fdinfo_key fragment_time_key = drm_clients.get_key("drm-engine-fragment");
+    const fdinfo_key vertex_time_key   = drm_clients.get_key("drm-engine-vertex-tiler");
+    const fdinfo_key memory_key        = drm_clients.get_key("drm-resident-memory");
+    const fdinfo_key freq_key          = drm_clients.get_key("drm-curfreq-fragment");
 
 protected:
     void pre_poll_overrides() override;
@@ -30,4 +33,5 @@ public:
     // Process-related functions
     int     get_process_load(pid_t pid)         override;
     float   get_process_vram_used(pid_t pid)    override;
+    void    get_process_engines(pid_t pid, gpu_engines_t& engines) override;
 };
@@ -0,0 +1,195 @@
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "poll_metrics.hpp"
+
+std::mutex current_metrics_lock;
+metrics current_metrics;
+
+static void add_to_group(process_group_t& group, const process_metrics& p, uint8_t num_of_gpus) {
+    group.num_of_processes++;
+
+    group.cpu_load += p.cpu.load;
+    group.resident += p.memory.resident;
+    group.pss += p.memory.pss;
+    group.swap += p.memory.swap;
+    group.read_mb_per_sec += p.io_stats.read_mb_per_sec;
+    group.write_mb_per_sec += p.io_stats.write_mb_per_sec;
+
+    for (uint8_t i = 0; i < num_of_gpus; i++) {
+        group.gpus[i].load += p.gpus[i].load;
+        group.gpus[i].vram_used += p.gpus[i].vram_used;
+        group.gpus[i].gtt_used += p.gpus[i].gtt_used;
+
+        for (uint8_t e = 0; e < p.gpus[i].engines.num_of_engines; e++)
+            add_engine_load(group.gpus[i].engines, p.gpus[i].engines.engines[e]);
+    }
+}
+
+void poll_metrics(
+    CPU& cpu, ProcessCPU& process_cpu, GPUS& gpus,
+    MemInfo& meminfo, VmStat& vmstat, ProcessMemory& process_memory,
+    Pressure& pressure, CgroupStats& cgroup_stats, IOStats& iostats,
+    ProcessRegistry& processes, const ProcessTree& process_tree
+) {
+    // Reused between ticks, so once pids and devices are stable copy
+    // assignments below reuse already allocated nodes and the whole
+    // tick doesn't touch the heap.
+    static metrics m = {};
+
+    {
+        std::unique_lock lock(current_metrics_lock);
+        m = current_metrics;
+    }
+
+    // ====START CPU INFO===========================================================
+    cpu.poll();
+
+    m.cpu = cpu.get_info();
+
+    uint16_t num_of_cores = 0;
+    for (const core_info_t& core : cpu.get_core_info()) {
+        m.cores[num_of_cores] = core;
+        num_of_cores++;
+    }
+
+    m.num_of_cores = num_of_cores;
+
+    m.num_of_power_domains = cpu.get_power_domains(
+        m.power_domains, sizeof(m.power_domains) / sizeof(m.power_domains[0])
+    );
+
+    process_cpu.poll();
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids)
+        proc.second.cpu = process_cpu.get_stats(proc.first);
+    // ====END CPU INFO=============================================================
+
+    // ====START GPU INFO===========================================================
+    uint8_t num_of_gpus = 0;
+
+    for (std::shared_ptr<GPU>& gpu : gpus.available_gpus) {
+        m.gpus[num_of_gpus] = gpu->get_system_metrics();
+        num_of_gpus++;
+
+        if (m.gpus[num_of_gpus].is_apu) {
+            float apu_power = m.gpus[num_of_gpus].apu_cpu_power;
+            int apu_temp  = m.gpus[num_of_gpus].apu_cpu_temp;
+
+            // maybe make it configurable
+            if (apu_power > m.cpu.power)
+                m.cpu.power = apu_power;
+
+            if (apu_temp > m.cpu.temp)
+                m.cpu.temp = apu_temp;
+        }
+    }
+
+    m.num_of_gpus = num_of_gpus;
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
+        const pid_t pid = proc.first;
+        num_of_gpus = 0;
+
+        for (std::shared_ptr<GPU>& gpu : gpus.available_gpus)
+            m.pids[pid].gpus[num_of_gpus++] = gpu->get_process_metrics(pid);
+    }
+    // ====END GPU INFO=============================================================
+
+    // ====START MEMORY INFO========================================================
+    process_memory.poll();
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
+        pid_t pid = proc.first;
+        std::shared_ptr<ProcessHandle> process = processes.get_handle(pid);
+
+        if (!process)
+            continue;
+
+        process_memory_t mem_stats = get_process_memory(*process);
+        process_memory_details_t details = process_memory.get_stats(pid);
+
+        proc.second.memory = {
+            .resident = mem_stats.resident,
+            .shared = mem_stats.shared,
+            .virt = mem_stats.virt,
+
+            .pss = details.pss,
+            .swap = details.swap,
+            .anon = details.anon,
+            .file = details.file,
+
+            .minor_faults_per_sec = details.minor_faults_per_sec,
+            .major_faults_per_sec = details.major_faults_per_sec
+        };
+    }
+
+    meminfo.poll();
+
+    m.memory = meminfo.get_info();
+
+    vmstat.poll();
+
+    m.vmstat = vmstat.get_rates();
+    // ====END MEMORY INFO==========================================================
+
+    // ====START PRESSURE INFO======================================================
+    pressure.poll();
+
+    m.pressure = pressure.get_system_pressure();
+    m.num_of_stall_events = pressure.get_recent_events(
+        m.stall_events, sizeof(m.stall_events) / sizeof(m.stall_events[0])
+    );
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids)
+        proc.second.cgroup_pressure = pressure.get_cgroup_pressure(proc.first);
+    // ====END PRESSURE INFO========================================================
+
+    // ====START CGROUP INFO========================================================
+    cgroup_stats.poll();
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids)
+        proc.second.cgroup = cgroup_stats.get_stats(proc.first);
+    // ====END CGROUP INFO==========================================================
+
+    // ====START IO INFO============================================================
+    iostats.poll();
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
+        pid_t pid = proc.first;
+        m.pids[pid].io_stats = iostats.get_stats(pid);
+    }
+    // ====END IO INFO==============================================================
+
+    // ====START PROCESS GROUPS=====================================================
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
+        std::shared_ptr<ProcessHandle> process = processes.get_handle(proc.first);
+        proc.second.is_client = process && process->is_client;
+    }
+
+    for (std::pair<const pid_t, process_metrics>& proc : m.pids) {
+        process_group_t& group = proc.second.group;
+        group = {};
+
+        const std::vector<pid_t>* members = process_tree.get_members(proc.first);
+
+        if (!members)
+            continue;
+
+        add_to_group(group, proc.second, m.num_of_gpus);
+
+        for (pid_t member : *members) {
+            auto it = m.pids.find(member);
+
+            if (it != m.pids.end())
+                add_to_group(group, it->second, m.num_of_gpus);
+        }
+    }
+    // ====END PROCESS GROUPS=======================================================
+
+    {
+        std::unique_lock lock(current_metrics_lock);
+        current_metrics = m;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "gpu.hpp"
+#include "memory.hpp"
+#include "pressure.hpp"
+#include "cgroup.hpp"
+#include "cpu/cpu.hpp"
+#include "cpu/process_cpu.hpp"
+#include "iostats.hpp"
+#include "process.hpp"
+#include "process_tree.hpp"
+
+// One tick of the main loop: polls every source and publishes the result
+// to current_metrics. Once tracked pids and devices are stable it must not
+// allocate, see tests/tick_allocations.cpp.
+void poll_metrics(
+    CPU& cpu, ProcessCPU& process_cpu, GPUS& gpus,
+    MemInfo& meminfo, VmStat& vmstat, ProcessMemory& process_memory,
+    Pressure& pressure, CgroupStats& cgroup_stats, IOStats& iostats,
+    ProcessRegistry& processes, const ProcessTree& process_tree
+);
@@ -0,0 +1,354 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <spdlog/spdlog.h>
+
+#include "pressure.hpp"
+#include "../common/log_errno.hpp"
+
+static const char* resource_names[PSI_RESOURCE_COUNT] = { "cpu", "memory", "io" };
+
+// Stall of 100ms within 1s window is already a visible hitch.
+// Unprivileged users may only use windows which are multiples of 2s,
+// so that is tried if the first one is rejected.
+static const char* trigger_specs[] = {
+    "some 100000 1000000",
+    "some 200000 2000000"
+};
+
+static uint64_t monotonic_ns() {
+    timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1'000'000'000ULL + ts.tv_nsec;
+}
+
+// "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+// "full avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+static void parse_pressure(const char* buf, pressure_stall_t& stall) {
+    for (const char* line = buf; line && *line;) {
+        const char* avg10 = std::strstr(line, "avg10=");
+        const char* total = std::strstr(line, "total=");
+        const char* eol = std::strchr(line, '\n');
+
+        if (avg10 && total && (!eol || total < eol)) {
+            float avg = std::strtof(avg10 + 6, nullptr);
+            uint64_t total_us = std::strtoull(total + 6, nullptr, 10);
+
+            if (std::strncmp(line, "some", 4) == 0) {
+                stall.some_avg10 = avg;
+                stall.some_total_us = total_us;
+            } else if (std::strncmp(line, "full", 4) == 0) {
+                stall.full_avg10 = avg;
+                stall.full_total_us = total_us;
+            }
+        }
+
+        line = eol ? eol + 1 : nullptr;
+    }
+}
+
+Pressure::Pressure() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd < 0)
+        LOG_UNIX_ERRNO_ERROR("Failed to create epoll fd for PSI triggers.");
+
+    system.id = 0;
+    system.path = "/proc/pressure";
+    open_group(system);
+}
+
+Pressure::~Pressure() {
+    close_group(system);
+
+    for (auto& c : cgroups)
+        close_group(c.second);
+
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+}
+
+void Pressure::open_group(group& g) {
+    for (int i = 0; i < PSI_RESOURCE_COUNT; i++) {
+        source& s = g.sources[i];
+        s.owner = &g;
+        s.resource = static_cast<psi_resource>(i);
+
+        // /proc/pressure/cpu and <cgroup>/cpu.pressure
+        std::string path = g.id == 0 ?
+            g.path + "/" + resource_names[i] :
+            g.path + "/" + resource_names[i] + ".pressure";
+
+        s.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (s.fd < 0) {
+            LOG_UNIX_ERRNO_DEBUG("psi: failed to open \"{}\".", path);
+            continue;
+        }
+
+        open_trigger(s, path);
+    }
+}
+
+void Pressure::open_trigger(source& s, const std::string& path) {
+    if (epoll_fd < 0)
+        return;
+
+    for (const char* spec : trigger_specs) {
+        int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+        if (fd < 0) {
+            LOG_UNIX_ERRNO_DEBUG("psi: failed to open \"{}\" for writing.", path);
+            return;
+        }
+
+        // trigger string must include null terminator
+        if (write(fd, spec, std::strlen(spec) + 1) < 0) {
+            LOG_UNIX_ERRNO_DEBUG("psi: trigger \"{}\" rejected by \"{}\".", spec, path);
+            close(fd);
+            continue;
+        }
+
+        epoll_event ev = {
+            .events = EPOLLPRI,
+            .data = { .ptr = &s }
+        };
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_UNIX_ERRNO_WARN("psi: failed to add trigger of \"{}\" to epoll.", path);
+            close(fd);
+            return;
+        }
+
+        SPDLOG_DEBUG("psi: registered trigger \"{}\" on \"{}\"", spec, path);
+        s.trigger_fd = fd;
+        return;
+    }
+}
+
+void Pressure::close_group(group& g) {
+    for (source& s : g.sources) {
+        if (s.trigger_fd >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s.trigger_fd, nullptr);
+            close(s.trigger_fd);
+            s.trigger_fd = -1;
+        }
+
+        if (s.fd >= 0) {
+            close(s.fd);
+            s.fd = -1;
+        }
+    }
+}
+
+void Pressure::add_pid(const ProcessHandle& process) {
+    if (clients.find(process.pid) != clients.end())
+        return;
+
+    client c = {};
+    c.last_seq = next_seq - 1;
+
+    std::string cgroup = process.get_cgroup();
+
+    // root cgroup pressure is the same as system-wide pressure
+    if (!cgroup.empty() && cgroup != "/") {
+        auto it = cgroups.find(cgroup);
+
+        if (it == cgroups.end()) {
+            it = cgroups.try_emplace(cgroup).first;
+            group& g = it->second;
+
+            g.id = next_group_id++;
+            g.path = "/sys/fs/cgroup" + cgroup;
+            open_group(g);
+
+            SPDLOG_DEBUG("psi: watching cgroup \"{}\"", g.path);
+        }
+
+        it->second.users++;
+        c.group_id = it->second.id;
+    }
+
+    clients.try_emplace(process.pid, c);
+}
+
+void Pressure::remove_pid(pid_t pid) {
+    auto client_it = clients.find(pid);
+
+    if (client_it == clients.end())
+        return;
+
+    int group_id = client_it->second.group_id;
+    clients.erase(client_it);
+
+    for (auto it = cgroups.begin(); it != cgroups.end(); it++) {
+        if (it->second.id != group_id)
+            continue;
+
+        if (--it->second.users <= 0) {
+            SPDLOG_DEBUG("psi: no clients left in cgroup \"{}\"", it->second.path);
+            close_group(it->second);
+            cgroups.erase(it);
+        }
+
+        return;
+    }
+}
+
+void Pressure::poll_group(group& g) {
+    char buf[256];
+
+    for (source& s : g.sources) {
+        if (s.fd < 0)
+            continue;
+
+        ssize_t len = pread(s.fd, buf, sizeof(buf) - 1, 0);
+
+        if (len <= 0)
+            continue;
+
+        buf[len] = '\0';
+        parse_pressure(buf, g.pressure.resources[s.resource]);
+    }
+}
+
+void Pressure::poll() {
+    poll_group(system);
+
+    for (auto& c : cgroups)
+        poll_group(c.second);
+}
+
+void Pressure::handle_trigger(source& s) {
+    group& g = *s.owner;
+
+    // refresh totals so the event carries stall time at the moment it fired
+    poll_group(g);
+
+    event_entry& e = events[next_seq % (sizeof(events) / sizeof(events[0]))];
+
+    e.seq = next_seq++;
+    e.group_id = g.id;
+    e.event = {
+        .timestamp_ns = monotonic_ns(),
+        .resource = s.resource,
+        .is_cgroup = g.id != 0,
+        .some_total_us = g.pressure.resources[s.resource].some_total_us
+    };
+
+    SPDLOG_DEBUG("psi: {} stall in {}", resource_names[s.resource], g.path);
+}
+
+void Pressure::handle_events() {
+    epoll_event ev[16];
+
+    while (true) {
+        int ret = epoll_wait(epoll_fd, ev, sizeof(ev) / sizeof(ev[0]), 0);
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+
+            LOG_UNIX_ERRNO_ERROR("epoll_wait() failed.");
+            return;
+        }
+
+        if (ret == 0)
+            return;
+
+        for (int i = 0; i < ret; i++) {
+            source* s = static_cast<source*>(ev[i].data.ptr);
+
+            // cgroup was removed
+            if (ev[i].events & EPOLLERR) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->trigger_fd, nullptr);
+                close(s->trigger_fd);
+                s->trigger_fd = -1;
+                continue;
+            }
+
+            handle_trigger(*s);
+        }
+    }
+}
+
+const Pressure::group* Pressure::find_group(int id) const {
+    if (id == 0)
+        return &system;
+
+    for (const auto& c : cgroups)
+        if (c.second.id == id)
+            return &c.second;
+
+    return nullptr;
+}
+
+pressure_t Pressure::get_cgroup_pressure(pid_t pid) const {
+    auto it = clients.find(pid);
+
+    if (it == clients.end() || it->second.group_id < 0)
+        return {};
+
+    const group* g = find_group(it->second.group_id);
+
+    return g ? g->pressure : pressure_t {};
+}
+
+uint8_t Pressure::get_recent_events(stall_event_t* out, uint8_t max) const {
+    const uint64_t size = sizeof(events) / sizeof(events[0]);
+    uint64_t first = next_seq > size ? next_seq - size : 1;
+    uint8_t count = 0;
+
+    // walk backwards to find the newest max events, then copy them in order
+    uint64_t seq = next_seq;
+
+    while (seq > first && count < max) {
+        seq--;
+
+        if (events[seq % size].group_id == 0)
+            count++;
+    }
+
+    count = 0;
+
+    for (; seq < next_seq; seq++) {
+        const event_entry& e = events[seq % size];
+
+        if (e.seq == seq && e.group_id == 0)
+            out[count++] = e.event;
+    }
+
+    return count;
+}
+
+uint8_t Pressure::take_client_events(pid_t pid, stall_event_t* out, uint8_t max) {
+    auto it = clients.find(pid);
+
+    if (it == clients.end())
+        return 0;
+
+    client& c = it->second;
+
+    const uint64_t size = sizeof(events) / sizeof(events[0]);
+    uint64_t first = next_seq > size ? next_seq - size : 1;
+    uint8_t count = 0;
+
+    // events older than the ring buffer are lost
+    if (c.last_seq + 1 < first)
+        c.last_seq = first - 1;
+
+    for (uint64_t seq = c.last_seq + 1; seq < next_seq && count < max; seq++) {
+        const event_entry& e = events[seq % size];
+        c.last_seq = seq;
+
+        if (e.group_id == 0 || e.group_id == c.group_id)
+            out[count++] = e.event;
+    }
+
+    return count;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <sys/types.h>
+
+#include "process.hpp"
+#include "../common/gpu_metrics.hpp"
+
+// Pressure Stall Information of the whole system (/proc/pressure/*)
+// and of cgroups of clients (<cgroup>/{cpu,memory,io}.pressure).
+// Averages are sampled every tick, stall episodes are not sampled:
+// a PSI trigger is registered on every file and the kernel wakes us
+// up with POLLPRI when the threshold is crossed.
+class Pressure {
+private:
+    struct group;
+
+    struct source {
+        int fd = -1;
+        int trigger_fd = -1;
+
+        group* owner = nullptr;
+        psi_resource resource = PSI_CPU;
+    };
+
+    struct group {
+        int id = 0;
+        std::string path;
+        source sources[PSI_RESOURCE_COUNT];
+        pressure_t pressure = {};
+        int users = 0;
+    };
+
+    struct client {
+        int group_id = -1;
+        uint64_t last_seq = 0;
+    };
+
+    struct event_entry {
+        uint64_t seq = 0;
+        int group_id = 0;
+        stall_event_t event;
+    };
+
+    int epoll_fd = -1;
+    int next_group_id = 1;
+
+    group system;
+    std::map<std::string, group> cgroups;
+    std::unordered_map<pid_t, client> clients;
+
+    // ring buffer of the most recent stall events
+    event_entry events[64];
+    uint64_t next_seq = 1;
+
+    void open_group(group& g);
+    void close_group(group& g);
+    void open_trigger(source& s, const std::string& path);
+    void poll_group(group& g);
+    void handle_trigger(source& s);
+    const group* find_group(int id) const;
+
+public:
+    Pressure();
+    ~Pressure();
+
+    Pressure(const Pressure&) = delete;
+    Pressure& operator=(const Pressure&) = delete;
+
+    // becomes readable (POLLIN) when one of triggers fires
+    int get_fd() const { return epoll_fd; }
+
+    void add_pid(const ProcessHandle& process);
+    void remove_pid(pid_t pid);
+
+    void poll();
+    void handle_events();
+
+    const pressure_t& get_system_pressure() const { return system.pressure; }
+    pressure_t get_cgroup_pressure(pid_t pid) const;
+
+    // most recent system-wide events, oldest first
+    uint8_t get_recent_events(stall_event_t* out, uint8_t max) const;
+
+    // events which weren't delivered to this client yet, oldest first
+    uint8_t take_client_events(pid_t pid, stall_event_t* out, uint8_t max);
+};
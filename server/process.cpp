@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <spdlog/spdlog.h>
+
+#include "process.hpp"
+#include "../common/log_errno.hpp"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+static int pidfd_open(pid_t pid) {
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int pidfd_send_signal(int pidfd, int sig) {
+    return syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0);
+}
+
+struct linux_dirent64 {
+    ino64_t         d_ino;
+    off64_t         d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[];
+};
+
+static const char* proc_file_names[ProcessHandle::PROC_FILE_COUNT] = {
+    "statm", "io", "stat", "schedstat", "status", "smaps_rollup"
+};
+
+uint32_t parse_subscriptions(std::string_view payload) {
+    static const std::pair<std::string_view, uint32_t> names[] = {
+        { "deep_memory", SUBSCRIBE_DEEP_MEMORY },
+        { "threads", SUBSCRIBE_THREADS },
+        { "sched", SUBSCRIBE_SCHED },
+        { "tree", SUBSCRIBE_TREE },
+        { "cgroup", SUBSCRIBE_CGROUP }
+    };
+
+    uint32_t flags = 0;
+
+    while (!payload.empty()) {
+        size_t end = payload.find_first_of(" ,\n");
+        std::string_view token = payload.substr(0, end);
+
+        for (const auto& n : names)
+            if (token == n.first)
+                flags |= n.second;
+
+        if (end == std::string_view::npos)
+            break;
+
+        payload.remove_prefix(end + 1);
+    }
+
+    return flags;
+}
+
+bool parse_stat(
+    const char* buf, uint64_t* fields, size_t num_fields,
+    char* comm_buf, size_t comm_size
+) {
+    // comm may contain spaces and parentheses, so it ends at the last ')'
+    const char* comm = std::strchr(buf, '(');
+    const char* pos = std::strrchr(buf, ')');
+
+    if (!comm || !pos || pos < comm)
+        return false;
+
+    if (comm_buf && comm_size > 0) {
+        size_t len = std::min<size_t>(pos - comm - 1, comm_size - 1);
+        std::memcpy(comm_buf, comm + 1, len);
+        comm_buf[len] = '\0';
+    }
+
+    pos++;
+
+    while (*pos == ' ')
+        pos++;
+
+    if (!*pos)
+        return false;
+
+    if (num_fields > 3)
+        fields[3] = *pos++;
+
+    char* end = nullptr;
+
+    for (size_t i = 4; i < num_fields; i++) {
+        fields[i] = std::strtoull(pos, &end, 10);
+
+        if (end == pos)
+            return false;
+
+        pos = end;
+    }
+
+    return true;
+}
+
+bool list_numeric_entries(int dir_fd, const char* path, std::vector<int>& out) {
+    int fd_dir = openat(dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd_dir < 0)
+        return false;
+
+    alignas(linux_dirent64) char buf[8192];
+
+    while (true) {
+        long nread = syscall(SYS_getdents64, fd_dir, buf, sizeof(buf));
+
+        if (nread <= 0)
+            break;
+
+        for (long pos = 0; pos < nread;) {
+            linux_dirent64* d = reinterpret_cast<linux_dirent64*>(buf + pos);
+            pos += d->d_reclen;
+
+            if (d->d_name[0] < '0' || d->d_name[0] > '9')
+                continue;
+
+            out.push_back(std::atoi(d->d_name));
+        }
+    }
+
+    close(fd_dir);
+    return true;
+}
+
+ProcessHandle::ProcessHandle(pid_t pid) : pid(pid) {
+    std::string path = "/proc/" + std::to_string(pid);
+    dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0) {
+        int err = errno;
+        LOG_UNIX_ERRNO_DEBUG("Failed to open {}.", path);
+        // checked by ProcessRegistry::add()
+        errno = err;
+    }
+}
+
+ProcessHandle::~ProcessHandle() {
+    for (auto& fd : fds)
+        if (fd >= 0)
+            close(fd);
+
+    if (dir_fd >= 0)
+        close(dir_fd);
+}
+
+int ProcessHandle::open_file(proc_file file) const {
+    int fd = openat(dir_fd, proc_file_names[file], O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        int err = errno;
+
+        // io and smaps_rollup require ptrace access,
+        // schedstat requires CONFIG_SCHED_INFO
+        LOG_UNIX_ERRNO_DEBUG("Failed to open /proc/{}/{}.", pid, proc_file_names[file]);
+
+        // out of fds is not permanent, try again on next read
+        if (err == EMFILE || err == ENFILE)
+            return -1;
+
+        fd = -2;
+    }
+
+    int expected = -1;
+
+    // other thread opened it first
+    if (!fds[file].compare_exchange_strong(expected, fd)) {
+        if (fd >= 0)
+            close(fd);
+
+        return expected;
+    }
+
+    return fd;
+}
+
+ssize_t ProcessHandle::read(proc_file file, char* buf, size_t size) const {
+    if (dir_fd < 0 || size == 0)
+        return -1;
+
+    int fd = fds[file];
+
+    if (fd == -1)
+        fd = open_file(file);
+
+    if (fd < 0)
+        return -1;
+
+    ssize_t len = pread(fd, buf, size - 1, 0);
+
+    if (len < 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+void ProcessHandle::list_fds(std::vector<int>& out) const {
+    out.clear();
+
+    if (!list_numeric_entries(dir_fd, "fd", out))
+        LOG_UNIX_ERRNO_DEBUG("Failed to open fd dir of pid {}.", pid);
+}
+
+void ProcessHandle::list_tasks(std::vector<int>& out) const {
+    out.clear();
+
+    if (!list_numeric_entries(dir_fd, "task", out))
+        LOG_UNIX_ERRNO_DEBUG("Failed to open task dir of pid {}.", pid);
+}
+
+int ProcessHandle::open_task_file(pid_t tid, const char* name) const {
+    char path[64];
+    std::snprintf(path, sizeof(path), "task/%d/%s", tid, name);
+
+    return openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+}
+
+ssize_t ProcessHandle::read_fd_link(int fd, char* buf, size_t size) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "fd/%d", fd);
+
+    ssize_t len = readlinkat(dir_fd, name, buf, size - 1);
+
+    if (len < 0)
+        return -1;
+
+    buf[len] = '\0';
+    return len;
+}
+
+int ProcessHandle::open_fdinfo(int fd) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "fdinfo/%d", fd);
+
+    return openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+}
+
+bool ProcessHandle::stat_fd(int fd, struct stat& st) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "fd/%d", fd);
+
+    return fstatat(dir_fd, name, &st, 0) == 0;
+}
+
+size_t ProcessHandle::get_fd_count() const {
+    struct stat st;
+
+    if (fstatat(dir_fd, "fd", &st, 0) < 0)
+        return 0;
+
+    return st.st_size;
+}
+
+std::string ProcessHandle::get_cgroup() const {
+    int fd = openat(dir_fd, "cgroup", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to open cgroup of pid {}.", pid);
+        return {};
+    }
+
+    char buf[4096];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+
+    if (len <= 0)
+        return {};
+
+    buf[len] = '\0';
+
+    // unified hierarchy entry is "0::/path"
+    for (char* line = buf; line && *line;) {
+        char* eol = std::strchr(line, '\n');
+
+        if (eol)
+            *eol = '\0';
+
+        if (std::strncmp(line, "0::", 3) == 0)
+            return line + 3;
+
+        line = eol ? eol + 1 : nullptr;
+    }
+
+    return {};
+}
+
+ProcessRegistry::ProcessRegistry() {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epoll_fd < 0)
+        LOG_UNIX_ERRNO_ERROR("Failed to create epoll fd for process tracking.");
+}
+
+ProcessRegistry::~ProcessRegistry() {
+    for (auto& p : processes)
+        if (p.second.pidfd >= 0)
+            close(p.second.pidfd);
+
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+}
+
+bool ProcessRegistry::add(pid_t pid) {
+    if (is_tracked(pid))
+        return true;
+
+    tracked_process proc = {};
+    proc.pidfd = pidfd_open(pid);
+
+    if (proc.pidfd < 0) {
+        if (errno == ESRCH) {
+            SPDLOG_DEBUG("pid {} exited before it could be tracked", pid);
+            return false;
+        }
+
+        if (errno == EMFILE || errno == ENFILE) {
+            warn_out_of_fds(pid);
+            return false;
+        }
+
+        LOG_UNIX_ERRNO_DEBUG("pidfd_open() failed for pid {}, falling back to kill().", pid);
+    } else if (pollfd pfd = { .fd = proc.pidfd, .events = POLLIN }; poll(&pfd, 1, 0) > 0) {
+        // zombie, e.g. a child which its parent hasn't reaped yet
+        SPDLOG_DEBUG("pid {} exited before it could be tracked", pid);
+        close(proc.pidfd);
+        return false;
+    } else {
+        epoll_event ev = {
+            .events = EPOLLIN,
+            .data = { .u64 = static_cast<uint64_t>(pid) }
+        };
+
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, proc.pidfd, &ev) < 0) {
+            LOG_UNIX_ERRNO_WARN("Failed to add pidfd of pid {} to epoll.", pid);
+            close(proc.pidfd);
+            proc.pidfd = -1;
+        }
+    }
+
+    proc.handle = std::make_shared<ProcessHandle>(pid);
+
+    if (!proc.handle->is_valid()) {
+        if (errno == EMFILE || errno == ENFILE)
+            warn_out_of_fds(pid);
+
+        if (proc.pidfd >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, proc.pidfd, nullptr);
+            close(proc.pidfd);
+        }
+
+        return false;
+    }
+
+    // if the process is still alive after /proc/<pid> was opened, then
+    // handle belongs to the same process as pidfd and not to reused pid
+    if (proc.pidfd >= 0 && pidfd_send_signal(proc.pidfd, 0) < 0 && errno == ESRCH) {
+        SPDLOG_DEBUG("pid {} exited before it could be tracked", pid);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, proc.pidfd, nullptr);
+        close(proc.pidfd);
+        return false;
+    }
+
+    out_of_fds = false;
+
+    SPDLOG_DEBUG("tracking pid {} (pidfd = {})", pid, proc.pidfd);
+    processes.try_emplace(pid, proc);
+
+    return true;
+}
+
+void ProcessRegistry::warn_out_of_fds(pid_t pid) {
+    // members of process groups are retried on every update
+    if (!out_of_fds)
+        SPDLOG_WARN("out of file descriptors, can't track pid {}", pid);
+
+    out_of_fds = true;
+}
+
+bool ProcessRegistry::is_tracked(pid_t pid) const {
+    return processes.find(pid) != processes.end();
+}
+
+std::shared_ptr<ProcessHandle> ProcessRegistry::get_handle(pid_t pid) const {
+    auto it = processes.find(pid);
+
+    if (it == processes.end())
+        return nullptr;
+
+    return it->second.handle;
+}
+
+void ProcessRegistry::for_each(
+    const std::function<void(const std::shared_ptr<ProcessHandle>&)>& f
+) const {
+    for (const auto& p : processes)
+        f(p.second.handle);
+}
+
+void ProcessRegistry::on_exit(std::function<void(pid_t, bool)> callback) {
+    exit_callbacks.push_back(std::move(callback));
+}
+
+void ProcessRegistry::remove(pid_t pid, bool exited) {
+    auto it = processes.find(pid);
+
+    if (it == processes.end())
+        return;
+
+    if (it->second.pidfd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.pidfd, nullptr);
+        close(it->second.pidfd);
+    }
+
+    processes.erase(it);
+
+    SPDLOG_DEBUG("pid {} is no longer tracked", pid);
+
+    for (auto& callback : exit_callbacks)
+        callback(pid, exited);
+}
+
+void ProcessRegistry::handle_exits() {
+    epoll_event events[16];
+
+    while (true) {
+        int ret = epoll_wait(epoll_fd, events, sizeof(events) / sizeof(events[0]), 0);
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+
+            LOG_UNIX_ERRNO_ERROR("epoll_wait() failed.");
+            return;
+        }
+
+        if (ret == 0)
+            return;
+
+        for (int i = 0; i < ret; i++) {
+            pid_t pid = static_cast<pid_t>(events[i].data.u64);
+
+            SPDLOG_DEBUG("pid {} exited", pid);
+            remove(pid, true);
+        }
+    }
+}
+
+void ProcessRegistry::check_processes_without_pidfd() {
+    std::vector<pid_t> exited;
+
+    for (const auto& p : processes) {
+        if (p.second.pidfd >= 0)
+            continue;
+
+        if (kill(p.first, 0) < 0 && errno == ESRCH)
+            exited.push_back(p.first);
+    }
+
+    for (pid_t pid : exited) {
+        SPDLOG_DEBUG("pid {} exited", pid);
+        remove(pid, true);
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <map>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Optional data which is expensive to collect, so it's refreshed every
+// tick only for clients which asked for it in their request message.
+enum process_subscription : uint32_t {
+    SUBSCRIBE_DEEP_MEMORY   = 1 << 0,
+    SUBSCRIBE_THREADS       = 1 << 1,
+    SUBSCRIBE_SCHED         = 1 << 2,
+    SUBSCRIBE_TREE          = 1 << 3,
+    SUBSCRIBE_CGROUP        = 1 << 4
+};
+
+// space or comma separated list of subscription names
+uint32_t parse_subscriptions(std::string_view payload);
+
+// Parses /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat. fields[i] is
+// field number i as numbered in proc(5), fields 1 (pid) and 2 (comm) are
+// skipped and field 3 (state) is stored as a character code.
+// Copies comm into comm_buf if it's not null. Returns false on malformed input.
+bool parse_stat(
+    const char* buf, uint64_t* fields, size_t num_fields,
+    char* comm_buf = nullptr, size_t comm_size = 0
+);
+
+// Appends numeric entries of directory at path relative to dir_fd
+// (e.g. fd numbers or tids) to out. Returns false if it can't be opened.
+bool list_numeric_entries(int dir_fd, const char* path, std::vector<int>& out);
+
+// Handle to /proc/<pid> which is opened once per client. All per-process
+// files are accessed relative to it, so there is no path building and
+// lookup on every tick, and the handle can't silently switch to another
+// process if pid gets reused (reads just start failing with ESRCH).
+// Files are opened on first read(), so members of process groups only
+// hold fds of files which are aggregated for them.
+class ProcessHandle {
+public:
+    enum proc_file {
+        STATM,
+        IO,
+        STAT,
+        SCHEDSTAT,
+        STATUS,
+        SMAPS_ROLLUP,
+        PROC_FILE_COUNT
+    };
+
+private:
+    int dir_fd = -1;
+    // -1 not opened yet, -2 open failed. read() may be called
+    // from the fdinfo scanner thread too.
+    mutable std::atomic<int> fds[PROC_FILE_COUNT] = { -1, -1, -1, -1, -1, -1 };
+
+    int open_file(proc_file file) const;
+
+public:
+    const pid_t pid;
+
+    // process_subscription flags from the last client request
+    std::atomic<uint32_t> subscriptions = 0;
+
+    // false for processes tracked only as part of a client's process group
+    std::atomic<bool> is_client = false;
+
+    explicit ProcessHandle(pid_t pid);
+    ~ProcessHandle();
+
+    ProcessHandle(const ProcessHandle&) = delete;
+    ProcessHandle& operator=(const ProcessHandle&) = delete;
+
+    bool is_valid() const { return dir_fd >= 0; }
+    int get_dir_fd() const { return dir_fd; }
+
+    // pread() of the whole file into buf, result is null-terminated.
+    // returns number of bytes read or -1.
+    ssize_t read(proc_file file, char* buf, size_t size) const;
+
+    // replace out with numeric entries of fd/ and task/ directories,
+    // out is reused by callers to not allocate on every listing
+    void list_fds(std::vector<int>& out) const;
+    void list_tasks(std::vector<int>& out) const;
+
+    // opens task/<tid>/<name>
+    int open_task_file(pid_t tid, const char* name) const;
+
+    ssize_t read_fd_link(int fd, char* buf, size_t size) const;
+    int open_fdinfo(int fd) const;
+
+    // stat() of the file fd refers to
+    bool stat_fd(int fd, struct stat& st) const;
+
+    // number of open fds, 0 if kernel doesn't report it (< 6.2)
+    size_t get_fd_count() const;
+
+    // cgroup v2 path relative to /sys/fs/cgroup ("/" for root cgroup),
+    // empty if process is not in unified hierarchy
+    std::string get_cgroup() const;
+};
+
+// Keeps a pidfd for every client process. pidfds become readable when
+// the process exits, so exits are picked up from the main event loop
+// instead of checking /proc/<pid> of every pid on every tick.
+// pidfds are also immune to pid reuse.
+class ProcessRegistry {
+private:
+    struct tracked_process {
+        int pidfd = -1;
+        std::shared_ptr<ProcessHandle> handle;
+    };
+
+    int epoll_fd = -1;
+    std::map<pid_t, tracked_process> processes;
+    std::vector<std::function<void(pid_t, bool)>> exit_callbacks;
+    // warned already, until next process is tracked
+    bool out_of_fds = false;
+
+    void remove(pid_t pid, bool exited);
+    void warn_out_of_fds(pid_t pid);
+
+public:
+    ProcessRegistry();
+    ~ProcessRegistry();
+
+    ProcessRegistry(const ProcessRegistry&) = delete;
+    ProcessRegistry& operator=(const ProcessRegistry&) = delete;
+
+    // becomes readable (POLLIN) when one of tracked processes exits
+    int get_fd() const { return epoll_fd; }
+
+    bool add(pid_t pid);
+    bool is_tracked(pid_t pid) const;
+    std::shared_ptr<ProcessHandle> get_handle(pid_t pid) const;
+
+    void for_each(const std::function<void(const std::shared_ptr<ProcessHandle>&)>& f) const;
+
+    // exit callbacks are called when tracked process exits (exited is
+    // true) or is removed while it's still running (false)
+    void on_exit(std::function<void(pid_t, bool)> callback);
+    void remove(pid_t pid) { remove(pid, false); }
+
+    void handle_exits();
+
+    // for kernels without pidfd_open() (< 5.3)
+    void check_processes_without_pidfd();
+};
@@ -0,0 +1,98 @@
+#include <memory>
+#include <mutex>
+
+#include "process_tracker.hpp"
+#include "fdinfo.hpp"
+#include "poll_metrics.hpp"
+
+ProcessTracker::ProcessTracker(
+    GPUS& gpus, ProcessCPU& process_cpu, ProcessMemory& process_memory,
+    Pressure& pressure, CgroupStats& cgroup_stats, IOStats& iostats,
+    ProcessRegistry& processes, ProcessTree& process_tree
+) :
+    gpus(gpus), process_cpu(process_cpu), process_memory(process_memory),
+    pressure(pressure), cgroup_stats(cgroup_stats), iostats(iostats),
+    processes(processes), process_tree(process_tree)
+{
+    track_member = [this](pid_t pid) { return track(pid); };
+    untrack_member = [this](pid_t pid) { untrack(pid); };
+
+    processes.on_exit([this](pid_t pid, bool exited) { on_exit(pid, exited); });
+}
+
+bool ProcessTracker::track(pid_t pid) {
+    if (processes.is_tracked(pid))
+        return true;
+
+    if (!processes.add(pid))
+        return false;
+
+    std::shared_ptr<ProcessHandle> process = processes.get_handle(pid);
+
+    process_cpu.add_pid(process);
+    iostats.add_pid(process);
+    process_memory.add_pid(process);
+    drm_clients.add_pid(process);
+
+    for (auto& gpu : gpus.available_gpus)
+        gpu->add_pid(pid);
+
+    std::unique_lock lock(current_metrics_lock);
+    current_metrics.pids.try_emplace(pid, process_metrics());
+
+    return true;
+}
+
+void ProcessTracker::untrack(pid_t pid) {
+    std::shared_ptr<ProcessHandle> process = processes.get_handle(pid);
+
+    // member which became a client itself
+    if (process && !process->is_client)
+        processes.remove(pid);
+}
+
+void ProcessTracker::on_exit(pid_t pid, bool exited) {
+    {
+        std::unique_lock lock(current_metrics_lock);
+        current_metrics.pids.erase(pid);
+    }
+
+    process_cpu.remove_pid(pid);
+    iostats.remove_pid(pid);
+    process_memory.remove_pid(pid);
+    pressure.remove_pid(pid);
+    cgroup_stats.remove_pid(pid);
+    process_tree.remove_pid(pid);
+
+    // members which are only untracked are still in the tree
+    if (exited)
+        process_tree.process_exited(pid);
+
+    drm_clients.remove_pid(pid);
+
+    for (auto& gpu : gpus.available_gpus)
+        gpu->remove_pid(pid);
+}
+
+bool ProcessTracker::track_client(pid_t pid, uint32_t subscriptions) {
+    if (!track(pid))
+        return false;
+
+    std::shared_ptr<ProcessHandle> process = processes.get_handle(pid);
+
+    // cgroup pressure and stats are not aggregated,
+    // so they are only watched for clients
+    if (!process->is_client) {
+        pressure.add_pid(*process);
+        cgroup_stats.add_pid(*process);
+    }
+
+    process->is_client = true;
+    process->subscriptions = subscriptions;
+
+    return true;
+}
+
+void ProcessTracker::update_groups() {
+    process_tree.update(processes, track_member, untrack_member);
+}
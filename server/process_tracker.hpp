@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <sys/types.h>
+
+#include "gpu.hpp"
+#include "memory.hpp"
+#include "pressure.hpp"
+#include "cgroup.hpp"
+#include "cpu/process_cpu.hpp"
+#include "iostats.hpp"
+#include "process.hpp"
+#include "process_tree.hpp"
+
+// Adds processes to every per-process source and removes them when they
+// exit or leave their group. Clients are tracked on their requests,
+// members of their process groups on update_groups().
+class ProcessTracker {
+private:
+    GPUS& gpus;
+    ProcessCPU& process_cpu;
+    ProcessMemory& process_memory;
+    Pressure& pressure;
+    CgroupStats& cgroup_stats;
+    IOStats& iostats;
+    ProcessRegistry& processes;
+    ProcessTree& process_tree;
+
+    // wrapped once, a temporary std::function per
+    // update_groups() would allocate every tick
+    std::function<bool(pid_t)> track_member;
+    std::function<void(pid_t)> untrack_member;
+
+    bool track(pid_t pid);
+    void untrack(pid_t pid);
+    void on_exit(pid_t pid, bool exited);
+
+public:
+    ProcessTracker(
+        GPUS& gpus, ProcessCPU& process_cpu, ProcessMemory& process_memory,
+        Pressure& pressure, CgroupStats& cgroup_stats, IOStats& iostats,
+        ProcessRegistry& processes, ProcessTree& process_tree
+    );
+
+    ProcessTracker(const ProcessTracker&) = delete;
+    ProcessTracker& operator=(const ProcessTracker&) = delete;
+
+    // request of a client, false if it couldn't be tracked
+    bool track_client(pid_t pid, uint32_t subscriptions);
+
+    // tracks new members of process groups and untracks former ones
+    void update_groups();
+};
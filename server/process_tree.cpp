@@ -0,0 +1,471 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <spdlog/spdlog.h>
+
+#include "process_tree.hpp"
+#include "../common/log_errno.hpp"
+
+ProcessTree::ProcessTree() {
+    has_children_files = access("/proc/thread-self/children", R_OK) == 0;
+
+    if (!has_children_files)
+        SPDLOG_INFO("task/<tid>/children is not available, process trees are built from a scan of /proc");
+
+    if (!connect_netlink())
+        SPDLOG_INFO("proc connector is not available, process trees will be rescanned periodically");
+}
+
+ProcessTree::~ProcessTree() {
+    if (listening)
+        set_listening(false);
+
+    if (netlink_fd >= 0)
+        close(netlink_fd);
+}
+
+bool ProcessTree::connect_netlink() {
+    netlink_fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+
+    if (netlink_fd < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to create proc connector socket.");
+        return false;
+    }
+
+    // group is joined by set_listening()
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+
+    if (bind(netlink_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to bind proc connector socket.");
+        close(netlink_fd);
+        netlink_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool ProcessTree::set_listening(bool listen) {
+    int group = CN_IDX_PROC;
+
+    // requires CAP_NET_ADMIN
+    if (listen && setsockopt(netlink_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to join proc connector group.");
+        return false;
+    }
+
+    // nlmsghdr + cn_msg + proc_cn_mcast_op
+    alignas(nlmsghdr) char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))] = {};
+
+    nlmsghdr* hdr = reinterpret_cast<nlmsghdr*>(request);
+    hdr->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+    hdr->nlmsg_type = NLMSG_DONE;
+
+    cn_msg* msg = static_cast<cn_msg*>(NLMSG_DATA(hdr));
+    msg->id = { .idx = CN_IDX_PROC, .val = CN_VAL_PROC };
+    msg->len = sizeof(proc_cn_mcast_op);
+
+    // kernel counts listeners and only reports events while there are any
+    proc_cn_mcast_op op = listen ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE;
+    std::memcpy(msg->data, &op, sizeof(op));
+
+    if (send(netlink_fd, request, hdr->nlmsg_len, 0) < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to send {} to proc connector.", listen ? "LISTEN" : "IGNORE");
+
+        if (listen) {
+            setsockopt(netlink_fd, SOL_NETLINK, NETLINK_DROP_MEMBERSHIP, &group, sizeof(group));
+            return false;
+        }
+    }
+
+    if (!listen)
+        setsockopt(netlink_fd, SOL_NETLINK, NETLINK_DROP_MEMBERSHIP, &group, sizeof(group));
+
+    listening = listen;
+
+    SPDLOG_DEBUG("{} proc connector events", listen ? "subscribed to" : "unsubscribed from");
+    return true;
+}
+
+void ProcessTree::handle_events() {
+    alignas(nlmsghdr) char buf[8192];
+
+    while (true) {
+        ssize_t len = recv(netlink_fd, buf, sizeof(buf), 0);
+
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+
+            // socket buffer overflowed, some events are lost
+            if (errno == ENOBUFS) {
+                SPDLOG_DEBUG("proc connector events were lost, rescanning");
+                needs_rescan = true;
+                continue;
+            }
+
+            if (errno != EAGAIN)
+                LOG_UNIX_ERRNO_ERROR("Failed to receive proc connector event.");
+
+            return;
+        }
+
+        // events queued before unsubscribing
+        if (!listening)
+            continue;
+
+        for (nlmsghdr* hdr = reinterpret_cast<nlmsghdr*>(buf);
+             NLMSG_OK(hdr, static_cast<size_t>(len));
+             hdr = NLMSG_NEXT(hdr, len)) {
+            if (hdr->nlmsg_type == NLMSG_ERROR || hdr->nlmsg_type == NLMSG_NOOP)
+                continue;
+
+            cn_msg* msg = static_cast<cn_msg*>(NLMSG_DATA(hdr));
+            proc_event* ev = reinterpret_cast<proc_event*>(msg->data);
+
+            switch (ev->what) {
+                case proc_event::PROC_EVENT_FORK:
+                    // new thread, not a new process
+                    if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+                        break;
+
+                    if (is_in_tree(ev->event_data.fork.parent_tgid))
+                        needs_rescan = true;
+
+                    break;
+
+                case proc_event::PROC_EVENT_EXIT:
+                    if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+                        break;
+
+                    // children of exited process are reparented
+                    if (is_in_tree(ev->event_data.exit.process_tgid))
+                        needs_rescan = true;
+
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+bool ProcessTree::is_in_tree(pid_t pid) const {
+    return groups.find(pid) != groups.end() || is_member(pid);
+}
+
+// appends whitespace separated pids from fd, they may not fit into one read
+static void read_pids(int fd, std::vector<pid_t>& out) {
+    char buf[4096];
+    size_t kept = 0;
+
+    while (true) {
+        ssize_t len = read(fd, buf + kept, sizeof(buf) - kept);
+
+        if (len <= 0)
+            break;
+
+        size_t end = kept + len;
+        size_t start = 0;
+
+        for (size_t i = 0; i < end; i++) {
+            if (buf[i] != ' ' && buf[i] != '\n')
+                continue;
+
+            if (i > start) {
+                buf[i] = '\0';
+                out.push_back(std::atoi(buf + start));
+            }
+
+            start = i + 1;
+        }
+
+        kept = end - start;
+        std::memmove(buf, buf + start, kept);
+    }
+
+    if (kept > 0 && kept < sizeof(buf)) {
+        buf[kept] = '\0';
+        out.push_back(std::atoi(buf));
+    }
+}
+
+void ProcessTree::scan() {
+    index.clear();
+    entries.clear();
+
+    if (!list_numeric_entries(AT_FDCWD, "/proc", entries)) {
+        LOG_UNIX_ERRNO_ERROR("Failed to open /proc.");
+        return;
+    }
+
+    char path[64];
+    char buf[1024];
+
+    // (3) state, (4) ppid
+    uint64_t fields[5] = {};
+
+    for (int pid : entries) {
+        std::snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            continue;
+
+        ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+        close(fd);
+
+        if (len <= 0)
+            continue;
+
+        buf[len] = '\0';
+
+        if (!parse_stat(buf, fields, 5))
+            continue;
+
+        // exited already, only waits for its parent to reap it
+        if (fields[3] == 'Z')
+            continue;
+
+        index.emplace_back(fields[4], pid);
+    }
+
+    std::sort(index.begin(), index.end());
+
+    SPDLOG_TRACE("process tree: scanned {} processes", index.size());
+}
+
+void ProcessTree::rescan() {
+    if (!has_children_files)
+        scan();
+
+    size_t count = 0;
+
+    for (auto& g : groups) {
+        std::vector<pid_t>& d = g.second.descendants;
+        d.clear();
+
+        if (g.second.mode & SUBSCRIBE_TREE)
+            get_descendants(g.first, d);
+
+        count += d.size();
+    }
+
+    needs_rescan = false;
+    last_scan = std::chrono::steady_clock::now();
+
+    SPDLOG_TRACE("process tree: {} descendants in {} groups", count, groups.size());
+}
+
+void ProcessTree::get_children(pid_t pid, std::vector<pid_t>& out) {
+    if (!has_children_files) {
+        auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(pid, pid_t(0)));
+
+        for (; it != index.end() && it->first == pid; it++)
+            out.push_back(it->second);
+
+        return;
+    }
+
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/task", pid);
+
+    entries.clear();
+
+    // exited already
+    if (!list_numeric_entries(AT_FDCWD, path, entries))
+        return;
+
+    // children are listed by thread which created them
+    for (int tid : entries) {
+        std::snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, tid);
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            continue;
+
+        read_pids(fd, out);
+        close(fd);
+    }
+}
+
+void ProcessTree::get_descendants(pid_t pid, std::vector<pid_t>& out) {
+    size_t first = out.size();
+    out.push_back(pid);
+
+    for (size_t i = first; i < out.size(); i++)
+        get_children(out[i], out);
+
+    out.erase(out.begin() + first);
+}
+
+void ProcessTree::get_cgroup_members(const std::string& procs_path, std::vector<pid_t>& out) const {
+    int fd = open(procs_path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        LOG_UNIX_ERRNO_DEBUG("Failed to open \"{}\".", procs_path);
+        return;
+    }
+
+    // one pid per line
+    read_pids(fd, out);
+    close(fd);
+}
+
+void ProcessTree::update(
+    const ProcessRegistry& processes,
+    const std::function<bool(pid_t)>& track,
+    const std::function<void(pid_t)>& untrack
+) {
+    bool needs_tree = false;
+
+    for (auto& g : groups) {
+        g.second.previous_mode = g.second.mode;
+        g.second.mode = 0;
+    }
+
+    processes.for_each([&](const std::shared_ptr<ProcessHandle>& process) {
+        uint32_t mode = process->subscriptions & (SUBSCRIBE_TREE | SUBSCRIBE_CGROUP);
+
+        if (!process->is_client || !mode)
+            return;
+
+        group& g = groups[process->pid];
+        g.mode = mode;
+
+        if ((mode & SUBSCRIBE_CGROUP) && g.cgroup.empty()) {
+            g.cgroup = process->get_cgroup();
+            g.cgroup_procs = "/sys/fs/cgroup" + g.cgroup + "/cgroup.procs";
+        }
+
+        if (mode & SUBSCRIBE_TREE)
+            needs_tree = true;
+
+        // new tree, walk it right away
+        if ((mode & SUBSCRIBE_TREE) && !(g.previous_mode & SUBSCRIBE_TREE))
+            needs_rescan = true;
+    });
+
+    for (auto it = groups.begin(); it != groups.end();) {
+        if (!it->second.mode)
+            it = groups.erase(it);
+        else
+            it++;
+    }
+
+    if (groups.empty() && members.empty() && !listening)
+        return;
+
+    if (needs_tree) {
+        // subscribe before the walk, so no fork in between is missed
+        if (netlink_fd >= 0 && !listening && !set_listening(true)) {
+            SPDLOG_INFO("proc connector is not available, process trees will be rescanned periodically");
+            close(netlink_fd);
+            netlink_fd = -1;
+        }
+
+        auto interval = listening ? rescan_interval : fallback_rescan_interval;
+
+        if (needs_rescan || std::chrono::steady_clock::now() - last_scan > interval)
+            rescan();
+    } else if (listening) {
+        set_listening(false);
+        // drop events queued before unsubscribing
+        handle_events();
+    }
+
+    new_members.clear();
+
+    for (auto& g : groups) {
+        pid_t pid = g.first;
+        std::vector<pid_t>& m = g.second.members;
+
+        m.clear();
+
+        if (g.second.mode & SUBSCRIBE_TREE)
+            m.insert(m.end(), g.second.descendants.begin(), g.second.descendants.end());
+
+        // root cgroup is the whole system
+        if ((g.second.mode & SUBSCRIBE_CGROUP) && !g.second.cgroup.empty() && g.second.cgroup != "/")
+            get_cgroup_members(g.second.cgroup_procs, m);
+
+        std::sort(m.begin(), m.end());
+        m.erase(std::unique(m.begin(), m.end()), m.end());
+        m.erase(std::remove(m.begin(), m.end(), pid), m.end());
+
+        bool capped = m.size() > max_group_members;
+
+        if (capped && !g.second.capped)
+            SPDLOG_WARN("pid {} has {} processes in its group, only {} are tracked", pid, m.size(), max_group_members);
+
+        g.second.capped = capped;
+        size_t tracked = 0;
+
+        // members which are gone already or can't be accessed,
+        // lowest pids are kept when group is too big
+        m.erase(std::remove_if(m.begin(), m.end(), [&](pid_t member) {
+            if (tracked == max_group_members || !track(member))
+                return true;
+
+            tracked++;
+            return false;
+        }), m.end());
+
+        new_members.insert(new_members.end(), m.begin(), m.end());
+    }
+
+    std::sort(new_members.begin(), new_members.end());
+    new_members.erase(std::unique(new_members.begin(), new_members.end()), new_members.end());
+
+    removed.clear();
+    std::set_difference(
+        members.begin(), members.end(), new_members.begin(), new_members.end(),
+        std::back_inserter(removed)
+    );
+
+    members.swap(new_members);
+
+    for (pid_t pid : removed)
+        untrack(pid);
+}
+
+void ProcessTree::remove_pid(pid_t pid) {
+    groups.erase(pid);
+
+    auto it = std::lower_bound(members.begin(), members.end(), pid);
+
+    if (it != members.end() && *it == pid)
+        members.erase(it);
+}
+
+void ProcessTree::process_exited(pid_t pid) {
+    // without proc connector exits of tracked processes are
+    // still known right away from their pidfds
+    needs_rescan = true;
+}
+
+bool ProcessTree::is_member(pid_t pid) const {
+    return std::binary_search(members.begin(), members.end(), pid);
+}
+
+const std::vector<pid_t>* ProcessTree::get_members(pid_t pid) const {
+    auto it = groups.find(pid);
+
+    if (it == groups.end())
+        return nullptr;
+
+    return &it->second.members;
+}
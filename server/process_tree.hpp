@@ -0,0 +1,106 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+
+#include "process.hpp"
+
+// Groups of processes which belong to a client, for games which run
+// through Proton, Wine, gamescope or shell wrappers and spread their
+// load over several processes.
+// Clients subscribed to "tree" get their descendants, clients subscribed
+// to "cgroup" get every process in their cgroup.
+//
+// Descendants are found by walking task/<tid>/children from the client
+// down, so only the client's own subtree is read. Trees are walked again
+// every fallback_rescan_interval, or with the proc connector when a process
+// of a group forks or exits. Events are only subscribed to while some
+// client uses "tree", they wake the server on every fork and exit.
+// Proc connector requires CAP_NET_ADMIN, so a server in user session
+// normally runs on the interval. Kernels without CONFIG_PROC_CHILDREN
+// get parents of all processes from a scan of /proc instead.
+class ProcessTree {
+private:
+    struct group {
+        uint32_t mode = 0;
+        uint32_t previous_mode = 0;
+        std::string cgroup;
+        std::string cgroup_procs;
+        // found by the last walk of the tree
+        std::vector<pid_t> descendants;
+        std::vector<pid_t> members;
+        // warned about max_group_members already
+        bool capped = false;
+    };
+
+    int netlink_fd = -1;
+    bool listening = false;
+
+    bool has_children_files = false;
+    bool needs_rescan = true;
+    std::chrono::time_point<std::chrono::steady_clock> last_scan;
+
+    // every member holds a few fds (/proc/<pid>, pidfd, stat, statm, io,
+    // smaps_rollup, drm fdinfo), keep big groups from running out of them
+    static constexpr size_t max_group_members = 32;
+
+    const std::chrono::seconds fallback_rescan_interval = std::chrono::seconds(2);
+    // events can be lost, so even with proc connector
+    // trees are walked again from time to time
+    const std::chrono::seconds rescan_interval = std::chrono::seconds(60);
+
+    // (parent, child) pairs sorted by parent, only without
+    // task/<tid>/children. Storage is reused between scans.
+    std::vector<std::pair<pid_t, pid_t>> index;
+    // reused for listing tasks and /proc
+    std::vector<int> entries;
+
+    std::map<pid_t, group> groups;
+    // sorted, the other two are reused by update()
+    std::vector<pid_t> members, new_members, removed;
+
+    bool connect_netlink();
+    bool set_listening(bool listen);
+    void scan();
+    void rescan();
+    bool is_in_tree(pid_t pid) const;
+
+    void get_children(pid_t pid, std::vector<pid_t>& out);
+    void get_descendants(pid_t pid, std::vector<pid_t>& out);
+    void get_cgroup_members(const std::string& procs_path, std::vector<pid_t>& out) const;
+
+public:
+    ProcessTree();
+    ~ProcessTree();
+
+    ProcessTree(const ProcessTree&) = delete;
+    ProcessTree& operator=(const ProcessTree&) = delete;
+
+    // proc connector socket while subscribed to its events, -1 otherwise
+    int get_fd() const { return listening ? netlink_fd : -1; }
+    void handle_events();
+
+    // Recomputes members of all groups. track is called for new members
+    // and returns false if process couldn't be tracked, untrack is called
+    // for processes which are not a member of any group anymore.
+    void update(
+        const ProcessRegistry& processes,
+        const std::function<bool(pid_t)>& track,
+        const std::function<void(pid_t)>& untrack
+    );
+
+    // process is no longer tracked, drops it from groups
+    void remove_pid(pid_t pid);
+    // process exited, its children were reparented
+    void process_exited(pid_t pid);
+
+    bool is_member(pid_t pid) const;
+
+    // members of client's group not including the client itself,
+    // nullptr if client isn't subscribed
+    const std::vector<pid_t>* get_members(pid_t pid) const;
+};
@@ -0,0 +1,119 @@
+// Counts NVML calls of a tick of Nvidia backend against libnvidia-ml-fake.so,
+// which is passed in MANGOHUD_NVML_LIBRARY. Every tick makes the same calls
+// no matter how many pids are tracked: one field values batch, process list
+// and utilization once, and static values only on init.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "../nvidia/nvidia.hpp"
+
+typedef uint64_t (*get_calls_t)(const char* name);
+
+static const struct {
+    const char* name;
+    uint64_t calls;
+} per_tick[] = {
+    { "nvmlDeviceGetFieldValues",                   1 },
+    { "nvmlDeviceGetUtilizationRates",              1 },
+    { "nvmlDeviceGetMemoryInfo",                    1 },
+    { "nvmlDeviceGetClockInfo",                     2 },
+    { "nvmlDeviceGetTemperature",                   1 },
+    { "nvmlDeviceGetFanSpeed",                      1 },
+    { "nvmlDeviceGetCurrentClocksThrottleReasons",  1 },
+    { "nvmlDeviceGetGraphicsRunningProcesses",      1 },
+    { "nvmlDeviceGetComputeRunningProcesses",       1 },
+    { "nvmlDeviceGetProcessUtilization",            1 },
+    // in the field values batch or read on init
+    { "nvmlDeviceGetPowerUsage",                    0 },
+    { "nvmlDeviceGetPowerManagementLimit",          0 },
+    { "nvmlDeviceGetHandleByPciBusId_v2",           0 },
+};
+
+static const size_t num_of_functions = sizeof(per_tick) / sizeof(per_tick[0]);
+
+// calls of one poll_once(), false if they are not as expected
+static bool check_tick(Nvidia& gpu, get_calls_t get_calls, const char* label) {
+    uint64_t before[num_of_functions];
+
+    for (size_t i = 0; i < num_of_functions; i++)
+        before[i] = get_calls(per_tick[i].name);
+
+    gpu.poll_once();
+
+    bool ok = true;
+
+    for (size_t i = 0; i < num_of_functions; i++) {
+        uint64_t calls = get_calls(per_tick[i].name) - before[i];
+
+        if (calls == per_tick[i].calls)
+            continue;
+
+        std::fprintf(
+            stderr, "%s: %s was called %llu times, expected %llu\n",
+            label, per_tick[i].name,
+            static_cast<unsigned long long>(calls),
+            static_cast<unsigned long long>(per_tick[i].calls)
+        );
+        ok = false;
+    }
+
+    return ok;
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::err);
+
+    const char* library = getenv("MANGOHUD_NVML_LIBRARY");
+
+    if (!library) {
+        std::fprintf(stderr, "MANGOHUD_NVML_LIBRARY is not set\n");
+        return 1;
+    }
+
+    // graphics processes reported by the fake library
+    setenv("MANGOHUD_FAKE_NVML_PIDS", "1000,1001,1002,1003", 1);
+
+    Nvidia gpu("renderD128", "00000000:01:00.0", 0x10de, 0x2684);
+
+    if (!gpu.nvml_available) {
+        std::fprintf(stderr, "failed to initialize NVML from %s\n", library);
+        return 1;
+    }
+
+    // already loaded by libnvml_loader
+    void* handle = dlopen(library, RTLD_NOW | RTLD_NOLOAD);
+    get_calls_t get_calls = handle
+        ? reinterpret_cast<get_calls_t>(dlsym(handle, "fake_nvml_get_calls"))
+        : nullptr;
+
+    if (!get_calls) {
+        std::fprintf(stderr, "%s is not libnvidia-ml-fake.so\n", library);
+        return 1;
+    }
+
+    gpu.add_pid(1000);
+
+    // first ticks grow process and utilization buffers
+    gpu.poll_once();
+    gpu.poll_once();
+
+    bool ok = check_tick(gpu, get_calls, "1 pid");
+
+    for (pid_t pid = 1001; pid < 1004; pid++)
+        gpu.add_pid(pid);
+
+    // not using the gpu
+    gpu.add_pid(getpid());
+
+    ok = check_tick(gpu, get_calls, "5 pids") && ok;
+
+    dlclose(handle);
+
+    std::printf("%s\n", ok ? "NVML calls per tick are constant" : "unexpected NVML calls");
+
+    return ok ? 0 : 1;
+}
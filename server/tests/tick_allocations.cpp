@@ -0,0 +1,170 @@
+// Counts heap allocations of all threads across steady-state ticks of
+// the main loop. Once tracked pids and devices are stable a tick should
+// only reuse memory allocated by the previous ones.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <new>
+#include <thread>
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../fdinfo.hpp"
+#include "../poll_metrics.hpp"
+#include "../process_tracker.hpp"
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+}
+
+// GPU threads allocate into the same counter
+static std::atomic<bool> counting = false;
+static std::atomic<size_t> allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+    if (counting)
+        allocations++;
+
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    if (counting)
+        allocations++;
+
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    if (counting)
+        allocations++;
+
+    return __libc_realloc(ptr, size);
+}
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size ? size : 1);
+
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+int main() {
+    using namespace std::chrono_literals;
+
+    // same as the main loop
+    const auto tick_interval = 500ms;
+    // longest periodic work is DRMClients::full_scan_interval, warmup
+    // runs it once more after the first scan and the counted ticks
+    // run every periodic path again
+    const auto window = 11s;
+    const int ticks = window / tick_interval;
+
+    spdlog::set_level(spdlog::level::err);
+
+    // member of the client's process tree
+    pid_t child = fork();
+
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    if (child == 0) {
+        // don't outlive the test if it aborts
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        pause();
+        _exit(0);
+    }
+
+    GPUS gpus;
+    CPU cpu;
+    ProcessCPU process_cpu;
+    MemInfo meminfo;
+    VmStat vmstat;
+    ProcessMemory process_memory;
+    Pressure pressure;
+    CgroupStats cgroup_stats;
+    IOStats iostats;
+    ProcessRegistry processes;
+    ProcessTree process_tree;
+
+    ProcessTracker tracker(
+        gpus, process_cpu, process_memory, pressure,
+        cgroup_stats, iostats, processes, process_tree
+    );
+
+    pid_t pid = getpid();
+    uint32_t subscriptions =
+        SUBSCRIBE_DEEP_MEMORY | SUBSCRIBE_THREADS | SUBSCRIBE_SCHED |
+        SUBSCRIBE_TREE | SUBSCRIBE_CGROUP;
+
+    if (!tracker.track_client(pid, subscriptions)) {
+        std::fprintf(stderr, "failed to track pid %d\n", pid);
+        kill(child, SIGKILL);
+        return 1;
+    }
+
+    auto tick = [&]() {
+        // short-lived child, with proc connector the tree is only
+        // walked again on forks and exits of its processes
+        pid_t temp = fork();
+
+        if (temp == 0)
+            _exit(0);
+
+        if (temp > 0)
+            waitpid(temp, nullptr, 0);
+
+        // main loop does these when their fds are readable
+        processes.handle_exits();
+
+        if (process_tree.get_fd() >= 0)
+            process_tree.handle_events();
+
+        processes.check_processes_without_pidfd();
+        tracker.update_groups();
+        poll_metrics(
+            cpu, process_cpu, gpus, meminfo, vmstat, process_memory,
+            pressure, cgroup_stats, iostats, processes, process_tree
+        );
+        // done by GPU threads, there are none without fdinfo-based GPUs
+        drm_clients.poll();
+        std::this_thread::sleep_for(tick_interval);
+    };
+
+    for (int i = 0; i < ticks; i++)
+        tick();
+
+    counting = true;
+
+    for (int i = 0; i < ticks; i++)
+        tick();
+
+    counting = false;
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+
+    std::printf("%zu allocations in %d ticks\n", allocations.load(), ticks);
+
+    return allocations ? 1 : 0;
+}